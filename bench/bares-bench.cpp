@@ -0,0 +1,431 @@
+/**
+ * @file    bares-bench.cpp
+ * @brief   Benchmark do bares: gera cargas de expressões sintéticas e
+            reprodutíveis (a partir de uma semente) e mede o tempo de
+            cada estágio do pipeline.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <iostream>  // cout, cerr
+#include <fstream>   // ofstream
+#include <sstream>   // ostringstream
+#include <string>    // std::string
+#include <vector>    // std::vector
+#include <chrono>    // steady_clock
+#include <random>    // std::mt19937_64
+#include <cstdlib>   // mkdtemp
+#include <cstdio>    // remove
+#include <iomanip>   // setw, setprecision
+#include <algorithm> // std::find
+
+#include <unistd.h>  // chdir, getcwd, rmdir
+
+#include "bares-manager.h" // classe BaresManager.
+#include "alocacoes.h"     // alocacoesGlobais.
+
+
+////////////////////////////////////////////////////////////////////////////
+// Gerador de cargas
+////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Essa eh a classe Gerador
+ *  Produz expressões pseudo-aleatórias. Usa apenas o mt19937_64 (cuja
+ *  sequência é fixada pelo padrão) e aritmética própria, então a mesma
+ *  semente gera a mesma carga em qualquer compilador.
+ */
+class Gerador {
+    public:
+        explicit Gerador( unsigned long long seed_ ) : rng( seed_ ) { /* empty */ }
+
+        /** @brief Sorteia um inteiro em [lo, hi]. */
+        long long between( long long lo, long long hi ){
+            return lo + static_cast< long long >( rng() % static_cast< unsigned long long >( hi - lo + 1 ) );
+        }
+
+        /** @brief Sorteia um operador binário. */
+        char op( const char * ops = "+-*/%" ){
+            std::string s( ops );
+            return s[ between( 0, s.size() - 1 ) ];
+        }
+
+        /** @brief Cadeia longa: muitos termos pequenos ligados por operadores. */
+        std::string chain( void ){
+            std::string e = std::to_string( between( 1, 99 ) );
+            int n = between( 16, 96 );
+            for( int i = 0; i < n; ++i ){
+                e += ' '; e += op( "+-+-*/%" ); e += ' ';
+                e += std::to_string( between( 1, 99 ) );
+            }
+            return e;
+        }
+
+        /** @brief Aninhamento profundo de parênteses, à esquerda e à direita.
+            Uma em cada oito linhas aninha identidades à esquerda. */
+        std::string nested( void ){
+            if ( between( 0, 7 ) == 0 )
+                return identities();
+            std::string e = std::to_string( between( 1, 9 ) );
+            int n = between( 32, 256 );
+            for( int i = 0; i < n; ++i ){
+                auto lit = std::to_string( between( 1, 9 ) );
+                char o = op( "+-*" );
+                if ( between( 0, 1 ) )
+                    e = "(" + e + o + lit + ")";
+                else
+                    e = lit + o + "(" + e + ")";
+            }
+            return e;
+        }
+
+        /** @brief Identidades à esquerda aninhadas: "1*(0+(...(1/0)+3)...+7)".
+            Cada nível descarta a constante da esquerda; um otimizador que
+            desloca o código de x a cada descarte fica quadrático aqui. */
+        std::string identities( void ){
+            int n = between( 512, 4096 );
+            std::string e;
+            for( int i = 0; i < n; ++i )
+                e += between( 0, 1 ) ? "1*(" : "0+(";
+            e += between( 0, 1 ) ? "(1/0)" : std::to_string( between( 1, 9 ) );
+            for( int i = 0; i < n; ++i ){
+                e += '+';
+                e += std::to_string( between( 1, 9 ) );
+                e += ')';
+            }
+            return e;
+        }
+
+        /** @brief Literais grandes (perto do limite de required_int_type). */
+        std::string literals( void ){
+            std::string e;
+            int n = between( 4, 24 );
+            for( int i = 0; i < n; ++i ){
+                if ( i > 0 ){ e += ' '; e += op( "+-" ); e += ' '; }
+                if ( between( 0, 3 ) == 0 ) e += '-';
+                e += std::to_string( between( 10000, 32767 ) );
+            }
+            return e;
+        }
+
+        /** @brief Linhas com erros de sintaxe e de execução misturados. */
+        std::string errors( void ){
+            std::string e = chain();
+            switch( between( 0, 6 ) ){
+                case 0: e += " +"; break;                           // missing term
+                case 1: e += ")"; break;                            // extraneous symbol
+                case 2: e = "(" + e; break;                         // missing ")"
+                case 3: e += " + 99999"; break;                     // out of range
+                case 4: e += " / (3 - 3)"; break;                   // division by zero
+                case 5: e[ between( 0, e.size() - 1 ) ] = '#'; break; // símbolo inválido
+                default: /* linha válida */ break;
+            }
+            return e;
+        }
+
+        /** @brief Gera uma linha da carga pedida. */
+        std::string line( const std::string & workload_, size_t i_ ){
+            if ( workload_ == "chain" )    return chain();
+            if ( workload_ == "nested" )   return nested();
+            if ( workload_ == "literals" ) return literals();
+            if ( workload_ == "errors" )   return errors();
+            // "mixed": alterna as cargas acima.
+            switch( i_ % 4 ){
+                case 0:  return chain();
+                case 1:  return nested();
+                case 2:  return literals();
+                default: return errors();
+            }
+        }
+
+    private:
+        std::mt19937_64 rng; //<! gerador com sequência fixada pelo padrão
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+// Medição
+////////////////////////////////////////////////////////////////////////////
+
+/// Medida de um estágio do pipeline.
+struct Estagio {
+    std::string nome;              //<! nome do estágio
+    double segundos;               //<! tempo de parede
+    unsigned long long allocs;     //<! chamadas ao alocador global
+};
+
+/// Resultado de uma carga.
+struct Medida {
+    std::string workload;          //<! nome da carga
+    size_t linhas;                 //<! número de linhas
+    size_t bytes;                  //<! tamanho da entrada
+    size_t tokens;                 //<! tokens infix das linhas válidas
+    size_t removidos;              //<! nós removidos pelo otimizador
+    std::vector< Estagio > estagios;
+};
+
+/**
+ * @brief Executa uma função e mede tempo e alocações.
+ * @param nome_ Nome do estágio.
+ * @param f_ Função a medir.
+ * @return Medida do estágio.
+ */
+template < typename F >
+Estagio medir( const std::string & nome_, F f_ ){
+    auto a0 = alocacoesGlobais();
+    auto t0 = std::chrono::steady_clock::now();
+    f_();
+    auto t1 = std::chrono::steady_clock::now();
+    return Estagio{ nome_, std::chrono::duration< double >( t1 - t0 ).count(), alocacoesGlobais() - a0 };
+}
+
+/**
+ * @brief Gera a carga em arquivo e mede o pipeline completo sobre ela.
+ * @param workload_ Nome da carga.
+ * @param seed_ Semente.
+ * @param linhas_ Número de linhas.
+ * @param jobs_ Threads (0: estágios seriais, um por um).
+ * @return Medidas da carga.
+ */
+Medida rodar( const std::string & workload_, unsigned long long seed_, size_t linhas_, unsigned jobs_ ){
+
+    Medida m;
+    m.workload = workload_;
+    m.linhas = linhas_;
+    m.bytes = 0;
+    m.tokens = 0;
+    m.removidos = 0;
+
+    // A carga vai para um arquivo, como na execução real.
+    {
+        Gerador g( seed_ );
+        std::ofstream arq( "entrada.txt" );
+        for( size_t i = 0; i < linhas_; ++i ){
+            auto e = g.line( workload_, i );
+            m.bytes += e.size() + 1;
+            arq << e << ( i + 1 < linhas_ ? "\n" : "" );
+        }
+    }
+
+    BaresManager manager;
+    manager.set_verbosity( BaresManager::verbosity_t::SILENT );
+
+    char arquivo[] = "entrada.txt";
+    m.estagios.push_back( medir( "initialize", [&]{ manager.initialize( arquivo ); } ) );
+    if ( jobs_ > 0 ){
+        m.estagios.push_back( medir( "process", [&]{ manager.processarParalelo( jobs_ ); } ) );
+    }
+    else {
+        m.estagios.push_back( medir( "parse",    [&]{ manager.validarExpress(); } ) );
+        m.estagios.push_back( medir( "convert",  [&]{ manager.converterExpress(); } ) );
+        m.estagios.push_back( medir( "evaluate", [&]{ manager.avaliarExpress(); } ) );
+    }
+    m.estagios.push_back( medir( "write", [&]{ manager.apresentarResult(); } ) );
+
+    for( const auto & rec : manager.get_records() )
+        if ( rec.status != Record::SYNTAX_ERROR ){
+            // O modo paralelo gera o postfix direto, sem os tokens infix.
+            m.tokens += rec.tokens.empty() ? rec.postfix.size() : rec.tokens.size();
+            m.removidos += rec.removed_nodes;
+        }
+
+    std::remove( "entrada.txt" );
+    std::remove( "resultados.txt" );
+
+    return m;
+}
+
+/**
+ * @brief Mede uma fórmula com variáveis avaliada para muitas linhas: uma
+ *        linha por vez (VM) e todas as linhas coluna a coluna (BatchVM).
+ * @param seed_ Semente.
+ * @param linhas_ Número de linhas (conjuntos de valores das variáveis).
+ * @return Medidas da carga.
+ */
+Medida rodarFormula( unsigned long long seed_, size_t linhas_ ){
+
+    const char * expr = "a * b + c - a * c + b * 3 - ( a - c ) * 2 + b ^ 2";
+
+    Medida m;
+    m.workload = "formula";
+    m.linhas = linhas_;
+    m.bytes = 0;
+    m.removidos = 0;
+
+    // Valores pequenos e grandes, para exercitar também o caminho escalar.
+    Gerador g( seed_ );
+    std::vector< std::vector< Token::value_type > > cols( 3, std::vector< Token::value_type >( linhas_ ) );
+    for( auto & c : cols )
+        for( auto & v : c )
+            v = g.between( 0, 99 ) ? g.between( -100000, 100000 ) : g.between( -3000000000LL, 3000000000LL );
+    std::vector< const Token::value_type * > ptrs = { cols[0].data(), cols[1].data(), cols[2].data() };
+
+    std::vector< Token::value_type > valores( linhas_ );
+    std::vector< std::uint8_t > erros( linhas_ );
+
+    BaresManager manager;
+    Formula formula;
+    m.estagios.push_back( medir( "compile", [&]{ manager.compilarFormula( expr, formula ); } ) );
+    m.tokens = formula.program.code.size() * linhas_;
+
+    // Mesma ordem das colunas: a, b, c.
+    std::vector< size_t > slot;
+    for( const char * nome : { "a", "b", "c" } )
+        slot.push_back( formula.slot( nome ) );
+
+    m.estagios.push_back( medir( "row", [&]{
+        std::vector< Token::value_type > linha( 3 );
+        for( size_t i = 0; i < linhas_; ++i ){
+            for( size_t v = 0; v < 3; ++v )
+                linha[ slot[v] ] = cols[v][i];
+            auto r = manager.avaliarFormula( formula, linha.data() );
+            valores[i] = r.value;
+            erros[i] = r.type;
+        }
+    } ) );
+
+    std::vector< const Token::value_type * > por_slot( 3 );
+    for( size_t v = 0; v < 3; ++v )
+        por_slot[ slot[v] ] = ptrs[v];
+    m.estagios.push_back( medir( "columnar", [&]{
+        manager.avaliarFormulaLote( formula, por_slot.data(), linhas_, valores.data(), erros.data() );
+    } ) );
+
+    return m;
+}
+
+/**
+ * @brief Imprime as medidas em JSON.
+ * @param os_ Fluxo de saída.
+ * @param seed_ Semente usada.
+ * @param ms_ Medidas de cada carga.
+ */
+void json( std::ostream & os_, unsigned long long seed_, const std::vector< Medida > & ms_ ){
+    os_ << "{\n  \"seed\": " << seed_ << ",\n  \"workloads\": [\n";
+    for( size_t i = 0; i < ms_.size(); ++i ){
+        const auto & m = ms_[i];
+        os_ << "    {\n"
+            << "      \"workload\": \"" << m.workload << "\",\n"
+            << "      \"lines\": " << m.linhas << ",\n"
+            << "      \"bytes\": " << m.bytes << ",\n"
+            << "      \"tokens\": " << m.tokens << ",\n"
+            << "      \"nodes_removed\": " << m.removidos << ",\n"
+            << "      \"stages\": [\n";
+        for( size_t j = 0; j < m.estagios.size(); ++j ){
+            const auto & e = m.estagios[j];
+            os_ << "        { \"stage\": \"" << e.nome << "\""
+                << ", \"seconds\": " << e.segundos
+                << ", \"lines_per_s\": " << m.linhas / e.segundos
+                << ", \"bytes_per_s\": " << m.bytes / e.segundos
+                << ", \"ns_per_token\": " << ( m.tokens ? e.segundos * 1e9 / m.tokens : 0.0 )
+                << ", \"allocs\": " << e.allocs
+                << ", \"allocs_per_expr\": " << double( e.allocs ) / m.linhas
+                << " }" << ( j + 1 < m.estagios.size() ? "," : "" ) << "\n";
+        }
+        os_ << "      ]\n    }" << ( i + 1 < ms_.size() ? "," : "" ) << "\n";
+    }
+    os_ << "  ]\n}\n";
+}
+
+/**
+ * @brief Imprime as medidas em forma de tabela.
+ * @param os_ Fluxo de saída.
+ * @param ms_ Medidas de cada carga.
+ */
+void tabela( std::ostream & os_, const std::vector< Medida > & ms_ ){
+    for( const auto & m : ms_ ){
+        os_ << ">>> " << m.workload << ": " << m.linhas << " linhas, "
+            << m.bytes << " bytes, " << m.tokens << " tokens, "
+            << m.removidos << " nos removidos pelo otimizador\n";
+        for( const auto & e : m.estagios ){
+            os_ << "    " << std::left << std::setw(11) << e.nome << std::right
+                << std::setw(12) << std::fixed << std::setprecision(1) << m.linhas / e.segundos << " linhas/s"
+                << std::setw(10) << std::setprecision(1) << m.bytes / e.segundos / 1e6 << " MB/s"
+                << std::setw(9) << std::setprecision(2) << ( m.tokens ? e.segundos * 1e9 / m.tokens : 0.0 ) << " ns/token"
+                << std::setw(9) << std::setprecision(2) << double( e.allocs ) / m.linhas << " allocs/expr\n";
+        }
+    }
+    os_ << std::defaultfloat;
+}
+
+
+/**
+*@brief Mostra como usar o benchmark.
+*@param prog Nome do executável.
+*/
+void usage( const char * prog ){
+    std::cerr << "Uso: " << prog << " [--seed S] [--lines N] [--workload NOME] [--jobs N] [--json ARQUIVO]\n"
+              << "  --workload  chain, nested, literals, errors, mixed, formula ou all (padrao: all)\n"
+              << "  --json      grava as medidas em JSON (\"-\" para a saida padrao)\n";
+}
+
+/**
+*@brief Função principal do benchmark.
+*/
+int main( int argc, char * argv[] ){
+
+    // Conta as alocações de todas as threads, para a coluna de alocações.
+    ligarContagemGlobal();
+
+    unsigned long long seed = 2017;
+    size_t linhas = 100000;
+    unsigned jobs = 0;
+    std::string workload = "all";
+    std::string saida_json;
+
+    for( int i = 1; i < argc; ++i ){
+        std::string arg( argv[i] );
+        if ( arg == "--seed" and i + 1 < argc )          seed = std::stoull( argv[++i] );
+        else if ( arg == "--lines" and i + 1 < argc )    linhas = std::stoull( argv[++i] );
+        else if ( arg == "--workload" and i + 1 < argc ) workload = argv[++i];
+        else if ( arg == "--jobs" and i + 1 < argc )     jobs = std::stoul( argv[++i] );
+        else if ( arg == "--json" and i + 1 < argc )     saida_json = argv[++i];
+        else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+
+    const std::vector< std::string > conhecidas = { "chain", "nested", "literals", "errors", "mixed", "formula" };
+    std::vector< std::string > cargas;
+    if ( workload == "all" )
+        cargas = conhecidas;
+    else if ( std::find( conhecidas.begin(), conhecidas.end(), workload ) != conhecidas.end() )
+        cargas = { workload };
+    else {
+        std::cerr << ">>> Carga desconhecida: \"" << workload << "\"\n";
+        usage( argv[0] );
+        return 1;
+    }
+
+    // Os arquivos temporários (entrada e resultados.txt) ficam num
+    // diretório próprio, para não sobrescrever nada do usuário.
+    char cwd[4096];
+    if ( getcwd( cwd, sizeof cwd ) == nullptr )
+        return 1;
+    char tmp[] = "/tmp/bares-bench-XXXXXX";
+    if ( mkdtemp( tmp ) == nullptr or chdir( tmp ) != 0 ){
+        std::cerr << ">>> Nao foi possivel criar o diretorio temporario\n";
+        return 1;
+    }
+
+    std::vector< Medida > ms;
+    for( const auto & c : cargas )
+        ms.push_back( c == "formula" ? rodarFormula( seed, linhas ) : rodar( c, seed, linhas, jobs ) );
+
+    if ( chdir( cwd ) != 0 )
+        return 1;
+    rmdir( tmp );
+
+    tabela( std::cout, ms );
+
+    if ( saida_json == "-" )
+        json( std::cout, seed, ms );
+    else if ( not saida_json.empty() ){
+        std::ofstream arq( saida_json );
+        json( arq, seed, ms );
+    }
+
+    return 0;
+}
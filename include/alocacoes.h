@@ -0,0 +1,28 @@
+/**
+ * @file    alocacoes.h
+ * @brief   Arquivo cabeçalho com a contagem de alocações do alocador
+            global (operator new), usada pelo --stats e pelo benchmark.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _ALOCACOES_H_
+#define _ALOCACOES_H_
+
+// O operator new com contagem fica em src/alocacoes.cpp, que é ligado
+// ao benchmark sempre e ao bares só com BARES_STATS: sem ele, o bares
+// usa o alocador padrão, sem custo nenhum.
+//
+// Cada alocação conta nos contadores da thread (Stats::coletor(), com
+// --stats) e, depois de ligarContagemGlobal(), num total do processo.
+
+/** @brief Passa a contar todas as alocações do processo, de todas as
+    threads (o benchmark usa). Chamar antes de criar threads. */
+void ligarContagemGlobal( void );
+
+/** @brief Alocações contadas desde ligarContagemGlobal().
+    @return Número de chamadas ao operator new. */
+unsigned long long alocacoesGlobais( void );
+
+#endif
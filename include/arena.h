@@ -0,0 +1,65 @@
+/**
+ * @file    arena.h
+ * @brief   Arquivo cabeçalho com a arena de memória usada pelos
+            registros de um lote de expressões.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <vector>          // std::vector
+#include <memory>          // std::unique_ptr
+#include <memory_resource> // std::pmr::memory_resource
+#include <cstddef>         // size_t, std::byte
+
+/**
+ *  Essa eh a classe Arena
+ *  Alocador monotônico: cada alocação só avança um ponteiro dentro do
+ *  bloco atual e a liberação individual não faz nada. A memória inteira
+ *  é devolvida de uma vez por reset(), entre um lote e outro, mas os
+ *  blocos continuam com a arena; depois do primeiro lote, os seguintes
+ *  não chamam mais o alocador global.
+ *
+ *  Não é thread-safe: cada thread usa a sua própria arena.
+ */
+class Arena : public std::pmr::memory_resource {
+    public:
+        /** @brief Cria uma arena vazia (nenhum bloco é alocado ainda).
+            @param bloco_ Tamanho do primeiro bloco, em bytes. */
+        explicit Arena( size_t bloco_ = 1 << 16 );
+
+        /** @brief Libera, de uma vez, tudo que foi alocado na arena.
+            Os blocos são mantidos para os próximos lotes. */
+        void reset( void );
+
+        /** @brief Memória reservada pela arena (soma dos blocos).
+            @return Capacidade, em bytes. */
+        size_t capacity( void ) const;
+
+        //==== Special methods
+        /// Desligar cópia e atribuição.
+        Arena( const Arena & ) = delete;  // Construtor cópia.
+        Arena & operator=( const Arena & ) = delete; // Atribuição.
+
+    private:
+        /// Um bloco de memória da arena.
+        struct Bloco {
+            std::unique_ptr< std::byte[] > dados; //<! Memória do bloco.
+            size_t tamanho;                        //<! Tamanho, em bytes.
+        };
+
+        std::vector< Bloco > blocos; //<! Blocos, na ordem de uso.
+        size_t primeiro;             //<! Tamanho do primeiro bloco.
+        size_t atual = 0;            //<! Índice do bloco em uso.
+        size_t usado = 0;            //<! Bytes já usados no bloco atual.
+
+        void * do_allocate( size_t bytes_, size_t align_ ) override;
+        void do_deallocate( void *, size_t, size_t ) override { /* liberado em reset() */ }
+        bool do_is_equal( const std::pmr::memory_resource & outro_ ) const noexcept override
+        { return this == &outro_; }
+};
+
+#endif
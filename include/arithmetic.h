@@ -0,0 +1,149 @@
+/**
+ * @file    arithmetic.h
+ * @brief   Arquivo cabeçalho com o núcleo aritmético do bares: as
+            operações inteiras com detecção de overflow e de divisão
+            por zero.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _ARITHMETIC_H_
+#define _ARITHMETIC_H_
+
+#include <limits>   // std::numeric_limits
+
+#include "token.h"    // struct Token.
+#include "bytecode.h" // struct EvalResult.
+
+// Todas as funções seguem o mesmo contrato: calculam n1 <op> n2 em r_
+// e devolvem EVAL_OK (zero) ou o código do erro. Ficam no cabeçalho para
+// que o compilador as expanda dentro do laço da VM; o caminho sem erro
+// custa uma instrução de "jump if overflow" além da própria operação.
+
+/// Dica para o compilador: o erro é o caso raro.
+#define BARES_UNLIKELY( x ) __builtin_expect( !!( x ), 0 )
+
+/**
+ * @brief Soma com detecção de overflow.
+ * @param n1 Primeiro operando.
+ * @param n2 Segundo operando.
+ * @param r_ Recebe o resultado.
+ * @return Código do erro (EVAL_OK se não houve erro).
+ */
+inline EvalResult::code_t op_add( Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    if ( BARES_UNLIKELY( __builtin_add_overflow( n1, n2, &r_ ) ) )
+        return EvalResult::NUMERIC_OVERFLOW;
+    return EvalResult::EVAL_OK;
+}
+
+/**
+ * @brief Subtração com detecção de overflow.
+ * @param n1 Primeiro operando.
+ * @param n2 Segundo operando.
+ * @param r_ Recebe o resultado.
+ * @return Código do erro (EVAL_OK se não houve erro).
+ */
+inline EvalResult::code_t op_sub( Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    if ( BARES_UNLIKELY( __builtin_sub_overflow( n1, n2, &r_ ) ) )
+        return EvalResult::NUMERIC_OVERFLOW;
+    return EvalResult::EVAL_OK;
+}
+
+/**
+ * @brief Multiplicação com detecção de overflow.
+ * @param n1 Primeiro operando.
+ * @param n2 Segundo operando.
+ * @param r_ Recebe o resultado.
+ * @return Código do erro (EVAL_OK se não houve erro).
+ */
+inline EvalResult::code_t op_mul( Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    if ( BARES_UNLIKELY( __builtin_mul_overflow( n1, n2, &r_ ) ) )
+        return EvalResult::NUMERIC_OVERFLOW;
+    return EvalResult::EVAL_OK;
+}
+
+/**
+ * @brief Divisão inteira (truncada em direção a zero).
+ * @param n1 Dividendo.
+ * @param n2 Divisor.
+ * @param r_ Recebe o quociente.
+ * @return DIVISION_BY_ZERO se n2 == 0; NUMERIC_OVERFLOW para MIN / -1.
+ */
+inline EvalResult::code_t op_div( Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    if ( BARES_UNLIKELY( n2 == 0 ) )
+        return EvalResult::DIVISION_BY_ZERO;
+    if ( BARES_UNLIKELY( n2 == -1 and n1 == std::numeric_limits< Token::value_type >::min() ) )
+        return EvalResult::NUMERIC_OVERFLOW;
+    r_ = n1 / n2;
+    return EvalResult::EVAL_OK;
+}
+
+/**
+ * @brief Resto da divisão inteira; o sinal acompanha o dividendo.
+ * @param n1 Dividendo.
+ * @param n2 Divisor.
+ * @param r_ Recebe o resto.
+ * @return DIVISION_BY_ZERO se n2 == 0.
+ */
+inline EvalResult::code_t op_mod( Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    if ( BARES_UNLIKELY( n2 == 0 ) )
+        return EvalResult::DIVISION_BY_ZERO;
+    // MIN % -1 é indefinido em C++, mas o resto é sempre zero.
+    r_ = ( n2 == -1 ) ? 0 : n1 % n2;
+    return EvalResult::EVAL_OK;
+}
+
+/**
+ * @brief Potenciação exata por quadrados sucessivos.
+ *
+ * Expoente negativo segue a divisão inteira de 1 por n1^|n2|: o
+ * resultado é 1 ou -1 para base ±1, zero para |base| > 1 e divisão
+ * por zero para base 0. Qualquer base elevada a zero vale 1.
+ *
+ * @param n1 Base.
+ * @param n2 Expoente.
+ * @param r_ Recebe o resultado.
+ * @return Código do erro (EVAL_OK se não houve erro).
+ */
+inline EvalResult::code_t op_pow( Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    if ( BARES_UNLIKELY( n2 < 0 ) )
+    {
+        if ( n1 == 0 )
+            return EvalResult::DIVISION_BY_ZERO;
+        if ( n1 == 1 )
+            r_ = 1;
+        else if ( n1 == -1 )
+            r_ = ( n2 & 1 ) ? -1 : 1;
+        else
+            r_ = 0;
+        return EvalResult::EVAL_OK;
+    }
+
+    Token::value_type base( n1 );
+    Token::value_type acc( 1 );
+
+    while ( n2 > 0 )
+    {
+        if ( n2 & 1 )
+        {
+            if ( BARES_UNLIKELY( __builtin_mul_overflow( acc, base, &acc ) ) )
+                return EvalResult::NUMERIC_OVERFLOW;
+        }
+        n2 >>= 1;
+        // Só eleva a base ao quadrado se ela ainda vai ser usada.
+        if ( n2 > 0 and BARES_UNLIKELY( __builtin_mul_overflow( base, base, &base ) ) )
+            return EvalResult::NUMERIC_OVERFLOW;
+    }
+
+    r_ = acc;
+    return EvalResult::EVAL_OK;
+}
+
+#endif
@@ -12,16 +12,34 @@
 
 #include <vector>   // std::vector
 #include <string>   // std::string
+#include <string_view> // std::string_view
 #include <fstream>  // ifstream, ofstream
 #include <iostream> // cin cout
 #include <iomanip>  // setw setfill
-#include <stack>    // pop push
+#include <memory>   // std::unique_ptr
 #include <cassert>   // assert
-#include <cmath>     // pow
-#include <stdexcept> // runtime_error
+#include <thread>    // std::thread
+#include <functional> // std::ref
+#include <algorithm> // std::min, std::find
+#include <charconv>  // std::from_chars
+#include <atomic>    // std::atomic
+#include <chrono>    // std::chrono::microseconds
+#include <limits>    // std::numeric_limits
+#include <mutex>     // std::mutex
 
 #include "token.h"  // struct Token.
 #include "parser.h" // classe Parser.
+#include "record.h" // struct Record.
+#include "bytecode.h" // Program, VM.
+#include "mapped-file.h" // classe MappedFile.
+#include "result-cache.h" // classe ResultCache.
+#include "formula.h" // struct Formula.
+#include "batch-vm.h" // classe BatchVM.
+#include "arena.h" // classe Arena.
+#include "ring-buffer.h" // SpscQueue, MpmcQueue.
+#include "stats.h" // classe Stats.
+#include "work-deque.h" // classe WorkDeque.
+#include "arithmetic.h" // op_add, op_sub.
 
 
 /**
@@ -32,38 +50,338 @@ class BaresManager{
 
     public:
 
+        /// Níveis de mensagens no console.
+        enum class verbosity_t : int
+        {
+            SILENT = 0, //<! Nada é impresso.
+            ERRORS,     //<! Apenas expressões com erro.
+            TRACE       //<! Log completo de cada estágio e de cada operação.
+        };
+
+        /** @brief Define o nível de mensagens no console.
+            @param v_ Nível desejado. */
+        void set_verbosity( verbosity_t v_ ){ verbosity = v_; }
+
+        /** @brief Liga o cache de resultados de processarParalelo() e
+            processarStream(): expressões repetidas (a menos de espaços)
+            reaproveitam o resultado anterior sem parsing nem avaliação.
+            Cada thread tem o seu cache. O cache não é usado com
+            verbosity_t::TRACE, que precisa dos tokens de cada linha.
+            @param capacidade_ Expressões por cache (0 desliga o cache). */
+        void set_cache( size_t capacidade_ );
+
+        /// Número de consultas ao cache com acerto (soma de todas as threads).
+        size_t cache_hits( void ) const;
+
+        /// Número de consultas ao cache sem acerto (soma de todas as threads).
+        size_t cache_misses( void ) const;
+
+        /// Contadores do pipeline de processarPipeline().
+        struct PipelineStats {
+            size_t lotes = 0;              //<! Lotes processados.
+            size_t amostras = 0;           //<! Amostras das filas (uma por lote recebido pelo escritor).
+            size_t soma_trabalho = 0;      //<! Soma das profundidades da fila leitor -> workers.
+            size_t max_trabalho = 0;       //<! Maior profundidade da fila leitor -> workers.
+            size_t soma_prontos = 0;       //<! Soma das profundidades da fila workers -> escritor.
+            size_t max_prontos = 0;        //<! Maior profundidade da fila workers -> escritor.
+            size_t esperas_leitor = 0;     //<! Vezes que o leitor esperou um lote livre.
+            size_t esperas_workers = 0;    //<! Vezes que um worker esperou um lote para processar.
+            size_t esperas_escritor = 0;   //<! Vezes que o escritor esperou um lote processado.
+        };
+
+        /** @brief Recupera os contadores da última chamada de processarPipeline().
+            @return Contadores. */
+        const PipelineStats & estatisticas_pipeline( void ) const { return pipeline; }
+
         /** @brief Inicializa lendo o arquivo de entrada fornecido pelo cliente.
+            O arquivo é mapeado na memória e cada expressão é uma view sobre
+            o mapeamento, sem cópias nem alocações por linha.
             @param arq Nome do arquivo de entrada.
             @return 1 se o arquivo foi lido corretamente; 0 otherwise. */
         int  initialize( char * arq );
 
         /** @brief Valida expressões e separa em tokens.
-            @return Vetor com os tokens de todas as expressões no formato infix. */
-        std::vector< std::vector< Token > > validarExpress();
+            Cada expressão é analisada uma única vez e o resultado fica
+            guardado no registro da linha correspondente. */
+        void validarExpress();
+
+        /** @brief Converte para postfix todas as expressões válidas.
+            Cada expressão é convertida direto para o registro da linha,
+            sem cópias intermediárias. */
+        void converterExpress();
+
+        /** @brief Avalia todas as expressões já convertidas para postfix.
+            Cada expressão é compilada para bytecode, otimizada e
+            executada na VM. */
+        void avaliarExpress();
+
+        /** @brief Mostra no console o que aconteceu com cada expressão, de
+            acordo com o nível de verbosidade. Os estágios de processamento
+            não imprimem nada; todo o log fica concentrado aqui. */
+        void apresentarConsole();
+
+        /** @brief Processa todas as expressões (parsing, conversão e avaliação)
+            dividindo as linhas entre várias threads. As linhas são
+            distribuídas por roubo de trabalho, em pedaços de tamanho
+            adaptativo, e uma linha muito longa é dividida nos seus termos
+            de fora, avaliados em paralelo.
+            @param jobs Número de threads. */
+        void processarParalelo( unsigned jobs );
+
+        /** @brief Processa a entrada em blocos de tamanho fixo: lê, avalia e
+            grava cada bloco antes de ler o próximo, então a memória usada
+            não depende do tamanho da entrada.
+            @param entrada Fluxo de entrada (arquivo ou std::cin).
+            @param jobs Número de threads por bloco (0 ou 1: serial).
+            @param bloco Número de linhas por bloco.
+            @return 1 se os resultados foram gravados; 0 otherwise. */
+        int processarStream( std::istream & entrada, unsigned jobs, size_t bloco = 65536 );
+
+        /** @brief Processa a entrada num pipeline de estágios simultâneos:
+            uma thread lê lotes de linhas, 'jobs' threads fazem o parsing
+            e a avaliação e a thread chamadora grava os resultados, na
+            ordem original. Os estágios trocam lotes por filas sem lock
+            e o número de lotes em circulação é fixo, então a memória não
+            cresce com a entrada: um estágio lento segura os anteriores.
+            Com verbosity_t::TRACE, cai no processarStream().
+            @param entrada Fluxo de entrada (arquivo ou std::cin).
+            @param jobs Número de threads de parsing e avaliação (0: 1).
+            @param bloco Número de linhas por lote.
+            @return 1 se os resultados foram gravados; 0 otherwise. */
+        int processarPipeline( std::istream & entrada, unsigned jobs, size_t bloco = 4096 );
+
+        /** @brief Avalia uma única expressão e grava a linha de resultado
+            (o mesmo texto de resultados.txt, com o '\n') em saida_.
+            Usado pelo modo servidor: o parser, o otimizador, a VM e o
+            registro da linha são reaproveitados entre as chamadas.
+            @param expr_ Expressão.
+            @param saida_ Fluxo que recebe o resultado. */
+        void responder( std::string_view expr_, std::ostream & saida_ );
+
+        /** @brief Compila uma expressão com variáveis uma única vez: parsing
+            (com identificadores), conversão para postfix, bytecode e
+            otimização. A fórmula pode então ser avaliada quantas vezes
+            for preciso, sem novo parsing.
+            @param expr_ Expressão, ex.: "preco * qtd - desconto".
+            @param formula_ Recebe o programa e os nomes das variáveis.
+            @return Resultado do parser (PARSER_OK se a fórmula é válida). */
+        Parser::ParserResult compilarFormula( std::string_view expr_, Formula & formula_ );
+
+        /** @brief Avalia uma fórmula compilada.
+            @param formula_ Fórmula compilada por compilarFormula().
+            @param valores_ Valor de cada variável, na ordem de formula_.variables.
+            @return Resultado da expressão (valor ou erro de execução). */
+        EvalResult avaliarFormula( const Formula & formula_, const Token::value_type * valores_ );
+
+        /** @brief Avalia uma fórmula compilada para um lote de linhas, coluna
+            a coluna (cada operação é aplicada a todas as linhas de uma vez).
+            @param formula_ Fórmula compilada por compilarFormula().
+            @param colunas_ Para cada variável (na ordem de formula_.variables),
+                   um vetor com o valor dela em cada linha.
+            @param n_ Número de linhas.
+            @param valores_ Recebe o valor de cada linha.
+            @param erros_ Recebe o código do erro de cada linha (EVAL_OK se não houve erro). */
+        void avaliarFormulaLote( const Formula & formula_, const Token::value_type * const * colunas_,
+                                 size_t n_, Token::value_type * valores_, std::uint8_t * erros_ );
+
+        /** @brief Avalia uma expressão com variáveis para cada linha de um
+            CSV e grava um resultado por linha em resultados.txt.
+            A primeira linha do CSV traz o nome das colunas; cada variável
+            da expressão recebe o valor da coluna de mesmo nome. A
+            expressão é compilada uma única vez e avaliada em lotes pela
+            VM colunar.
+            @param expr_ Expressão com variáveis.
+            @param csv_ Fluxo com o CSV.
+            @return 1 se os resultados foram gravados; 0 otherwise. */
+        int processarBindings( std::string_view expr_, std::istream & csv_ );
 
         /** @brief Transforma expressão do formado infix para postfix.
-            @param inflix_ Tokens da expressão no formato infix
-            @return Vetor com os tokens de todas as expressões no formato postfix. */
-        std::vector< std::vector< Token > > infix_to_postfix( std::vector< Token > infix_ );
+            @param infix_ Tokens da expressão no formato infix
+            @return Tokens da expressão no formato postfix. */
+        TokenList infix_to_postfix( const TokenList & infix_ );
+
+        /** @brief Transforma expressão do formado infix para postfix.
+            @param infix_ Tokens da expressão no formato infix
+            @param postfix_ Buffer que recebe os tokens no formato postfix
+                   (é esvaziado antes, mas a capacidade é aproveitada). A
+                   pilha de operadores usa um buffer local e, se crescer
+                   além dele, o mesmo memory_resource de postfix_. */
+        void infix_to_postfix( const TokenList & infix_, TokenList & postfix_ );
 
         /** @brief Realiza a operação.
             @param postfix Vetor com tokens da expressão no formato postfix
-            @return Resultado da expressão. */
-        int evaluate_postfix( std::vector< Token > postfix );
+            @param valores Valor de cada variável, pelo índice (apenas se
+                   a expressão tem variáveis)
+            @return Resultado da expressão (valor ou erro de execução). */
+        EvalResult evaluate_postfix( const TokenList & postfix, const Token::value_type * valores = nullptr );
 
         /** @brief Apresenta resultado final das expressões.
-            @param res Vetor com resultados das expressões válidas */
-        void apresentarResult( std::vector< int > res );
+            Apenas escreve os registros já processados, sem refazer o parsing. */
+        void apresentarResult();
+
+        /** @brief Recupera os registros das expressões.
+            @return Registros, na ordem de entrada. */
+        const std::vector< Record > & get_records( void ) const { return records; }
 
     private:
-        std::vector<std::string> expressions;          //<! expressoes a serem analisadas
-        std::vector< std::vector< Token > > postfix;   //<! todas as expressao na forma posfixa
+        static constexpr size_t TAMANHO_BUFFER_SAIDA = 1 << 20; //<! buffer do arquivo de saída
+
+        verbosity_t verbosity = verbosity_t::TRACE; //<! nivel de mensagens no console
+        std::vector<char> buffer_saida;        //<! buffer de escrita do resultados.txt
+        MappedFile arquivo;                    //<! arquivo de entrada mapeado na memoria
+        std::vector<std::string> linhas;       //<! buffer das linhas lidas no modo stream
+        std::vector<std::string_view> expressions; //<! expressoes a serem analisadas
+        std::vector< std::unique_ptr< Arena > > arenas; //<! uma arena por thread, para os registros
+        std::vector< Record > records;         //<! registro de cada expressao, na ordem de entrada
+        VM vm;                                 //<! maquina virtual que avalia as expressoes
+        Optimizer otimizador;                  //<! passo de otimizacao do bytecode
+        BatchVM lote;                          //<! maquina virtual colunar (formulas em lote)
+        size_t capacidade_cache = 0;           //<! expressoes por cache (0: sem cache)
+        std::vector< ResultCache > caches;     //<! um cache de resultados por thread
+        std::vector< std::unique_ptr< Parser > > parsers; //<! um parser por thread, reaproveitado entre os blocos
+        PipelineStats pipeline;                //<! contadores do ultimo processarPipeline()
+
+        /// Um lote de linhas do pipeline, com os registros e a arena deles.
+        struct Lote {
+            size_t seq = 0;                    //<! Posição do lote na entrada.
+            size_t n = 0;                      //<! Linhas usadas de 'linhas'.
+            std::vector< std::string > linhas; //<! Linhas lidas (a capacidade é reaproveitada).
+            std::vector< Record > records;     //<! Registro de cada linha.
+            Arena arena;                       //<! Memória dos registros.
+        };
+        Record avulso;                         //<! registro das expressoes avaliadas por responder()
+
+        // Escalonador de processarParalelo(): cada worker tem uma deque de
+        // tarefas e, quando ela esvazia, rouba das deques dos outros.
+
+        static constexpr size_t TAMANHO_PEDACO = 64 * 1024;   //<! Bytes de texto de um pedaço de linhas.
+        static constexpr size_t LIMITE_DIVISAO = 256 * 1024;  //<! Linhas a partir deste tamanho são divididas.
+        static constexpr size_t TAMANHO_GRUPO = 64 * 1024;    //<! Bytes de texto de um grupo de termos.
+
+        /// Uma linha longa dividida nos termos de fora ("t0 + t1 - t2 ...").
+        struct Divisao {
+            size_t linha = 0;                        //<! Índice da linha.
+            std::vector< std::string_view > termos;  //<! Termos, sem os operadores.
+            std::vector< char > operadores;          //<! Operador antes de cada termo ('+' no primeiro).
+            std::vector< size_t > grupos;            //<! Primeiro termo de cada grupo, mais o fim.
+            std::vector< EvalResult > resultados;    //<! Resultado de cada termo.
+            std::atomic< size_t > faltam{ 0 };       //<! Grupos ainda não avaliados.
+            std::atomic< bool > invalida{ false };   //<! Algum termo falhou no parser.
+            std::atomic< Stats::ticks_t > ticks_parse{ 0 }; //<! Parsing dos termos, somado (--stats).
+            std::atomic< Stats::ticks_t > ticks_eval{ 0 };  //<! Avaliação dos termos, somada (--stats).
+            std::atomic< size_t > tokens{ 0 };       //<! Tokens dos termos (--stats).
+        };
+
+        /// Tarefa: linhas [inicio, fim) ou, com divisao, grupos [inicio, fim) da divisão.
+        struct Tarefa {
+            size_t inicio = 0;                 //<! Primeira linha (ou grupo).
+            size_t fim = 0;                    //<! Uma posição após a última.
+            Divisao * divisao = nullptr;       //<! Linha dividida (nullptr: tarefa de linhas).
+        };
+
+        /// Estado de um worker, mantido entre as chamadas (blocos do modo stream).
+        struct Trabalhador {
+            WorkDeque< Tarefa > tarefas;       //<! Tarefas do worker.
+            Optimizer otimizador;              //<! Otimizador do worker.
+            VM vm;                             //<! Máquina virtual do worker.
+            TokenList termo;                   //<! Postfix de um termo de linha dividida.
+            Program programa;                  //<! Bytecode de um termo de linha dividida.
+        };
+
+        /// Estado compartilhado de uma chamada de processarParalelo().
+        struct Escala {
+            unsigned jobs = 1;                 //<! Número de workers.
+            bool trace = false;                //<! verbosity_t::TRACE (sem divisão de linhas).
+            bool usar_cache = false;           //<! Usa o cache de cada worker.
+            std::atomic< size_t > restantes{ 0 }; //<! Linhas ainda não terminadas.
+            std::mutex trava;                  //<! Protege divisoes.
+            std::vector< std::unique_ptr< Divisao > > divisoes; //<! Linhas divididas desta chamada.
+        };
+
+        std::vector< std::unique_ptr< Trabalhador > > trabalhadores; //<! um por thread de processarParalelo()
+        std::vector< size_t > acumulado;       //<! acumulado[i]: bytes das linhas antes da linha i
+
+        /** @brief Laço de um worker: executa as tarefas da sua deque e,
+            sem tarefas, rouba das outras, até todas as linhas terminarem.
+            @param k Índice do worker.
+            @param e Estado da chamada. */
+        void trabalhar( unsigned k, Escala & e );
+
+        /** @brief Processa um pedaço de linhas [first, last) no worker k.
+            @param k Índice do worker.
+            @param first Primeira linha do pedaço.
+            @param last Uma posição após a última linha do pedaço.
+            @param e Estado da chamada. */
+        void processarPedaco( unsigned k, size_t first, size_t last, Escala & e );
+
+        /** @brief Divide uma linha longa nos termos de fora e distribui os
+            grupos de termos como tarefas (o primeiro grupo é avaliado aqui).
+            @param k Índice do worker.
+            @param linha Índice da linha.
+            @param e Estado da chamada.
+            @return false se a linha não pode ser dividida. */
+        bool dividirLinha( unsigned k, size_t linha, Escala & e );
+
+        /** @brief Avalia os grupos [first, last) de uma linha dividida; o
+            último worker a terminar monta o resultado da linha.
+            @param k Índice do worker.
+            @param d Linha dividida.
+            @param first Primeiro grupo.
+            @param last Uma posição após o último grupo.
+            @param e Estado da chamada. */
+        void avaliarGrupos( unsigned k, Divisao & d, size_t first, size_t last, Escala & e );
+
+        /** @brief Monta o resultado de uma linha dividida a partir dos termos.
+            @param k Índice do worker.
+            @param d Linha dividida, com todos os termos avaliados. */
+        void combinarTermos( unsigned k, Divisao & d );
+
+        /** @brief Prepara os registros de um novo lote de linhas.
+            As arenas são zeradas e o registro da linha i passa a alocar
+            na arena do bloco i / bloco (a arena da thread que vai
+            processá-lo).
+            @param n Número de linhas do lote.
+            @param bloco Linhas por bloco (por thread). */
+        void prepararRegistros( size_t n, size_t bloco );
+
+        /** @brief Processa um intervalo de linhas [first, last).
+            Cada chamada usa seu próprio Parser e sua própria VM, então
+            intervalos disjuntos podem rodar em threads diferentes.
+            @param first Primeira linha do intervalo.
+            @param last Uma posição após a última linha do intervalo.
+            @param my_parser Parser da thread (a capacidade é mantida entre as chamadas).
+            @param cache Cache de resultados da thread (nullptr: sem cache). */
+        void processarIntervalo( size_t first, size_t last, Parser & my_parser, ResultCache * cache );
+
+        /** @brief Processa uma linha: parsing, conversão, bytecode e avaliação.
+            @param expr_ Expressão.
+            @param rec Registro da linha (recebe o estado final).
+            @param my_parser Parser (já configurado com emit_postfix( not trace )).
+            @param my_opt Otimizador.
+            @param my_vm Máquina virtual.
+            @param trace true para guardar também os tokens infix. */
+        void processarLinha( std::string_view expr_, Record & rec, Parser & my_parser,
+                             Optimizer & my_opt, VM & my_vm, bool trace );
+
+        /** @brief Mostra no console a mensagem de uma expressão com erro
+            (nível verbosity_t::ERRORS).
+            @param rec Registro da expressão
+            @param expr Texto da expressão */
+        void apresentarErro( const Record & rec, std::string_view expr );
+
+        /** @brief Grava o resultado de um registro (sem o '\n').
+            @param arqsaida Fluxo de saída dos resultados
+            @param rec Registro da expressão */
+        void escreverRegistro( std::ostream & arqsaida, const Record & rec );
+
+        /** @brief Grava o resultado de cada registro, um por linha.
+            @param arqsaida Fluxo de saída dos resultados */
+        void escreverRegistros( std::ostream & arqsaida );
 
         /** @brief Apresenta mensagem final das expressões com erro de sintaxe.
-            @param cont Contador
             @param arqsaida Arquivo de saída dos resultados
             @param result O resultado do Parser */
-        void message( int cont, std::ofstream & arqsaida, const Parser::ParserResult & result );
+        void message( std::ostream & arqsaida, const Parser::ParserResult & result );
 
 };
 
@@ -0,0 +1,74 @@
+/**
+ * @file    batch-vm.h
+ * @brief   Arquivo cabeçalho com a máquina virtual colunar, que executa
+            um programa sobre um lote inteiro de valores de variáveis.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _BATCH_VM_H_
+#define _BATCH_VM_H_
+
+#include <vector>   // std::vector
+#include <cstdint>  // std::uint8_t
+#include <cstddef>  // size_t
+
+#include "token.h"    // struct Token.
+#include "bytecode.h" // Program, EvalResult.
+
+/**
+ *  Essa eh a classe BatchVM
+ *  Avalia o mesmo programa para muitas linhas de uma vez. A pilha é
+ *  colunar (structure of arrays): cada posição da pilha é um vetor com
+ *  um valor por linha, e cada instrução é aplicada ao vetor inteiro.
+ *
+ *  "+", "-" e "*" usam kernels AVX2 ou SSE4.1, escolhidos em tempo de
+ *  execução conforme a CPU, com detecção de overflow por linha; "/",
+ *  "%" e "^" usam o núcleo aritmético escalar. Cada linha guarda o
+ *  primeiro erro que encontrou, então o resultado de cada linha é o
+ *  mesmo de VM::run sobre aquela linha.
+ */
+class BatchVM {
+    public:
+        /// Número de linhas processadas por vez (cabe no cache L1/L2).
+        static constexpr size_t BLOCO = 1024;
+
+        /** @brief Cria a máquina e escolhe os kernels para a CPU atual. */
+        BatchVM();
+
+        /** @brief Executa um programa para n_ linhas.
+            @param prog_ Programa compilado.
+            @param cols_ Para cada variável (pelo índice), um vetor com o
+                   valor dela em cada uma das n_ linhas.
+            @param n_ Número de linhas.
+            @param values_ Recebe o valor de cada linha.
+            @param errors_ Recebe o código do erro de cada linha
+                   (EvalResult::EVAL_OK se não houve erro). */
+        void run( const Program & prog_, const Token::value_type * const * cols_, size_t n_,
+                  Token::value_type * values_, std::uint8_t * errors_ );
+
+        /** @brief Nome dos kernels em uso ("avx2", "sse4.1" ou "scalar").
+            @return Nome do conjunto de instruções. */
+        const char * isa( void ) const { return nome_isa; }
+
+        /** @brief Troca os kernels pelos de um conjunto de instruções
+                   (usado pelos testes, para cobrir cada um deles).
+            @param isa_ "avx2", "sse4.1" ou "scalar".
+            @return false se a CPU ou o build não têm esse conjunto. */
+        bool forcar( const char * isa_ );
+
+    private:
+        /// Kernel vetorial: a[i] = a[i] <op> b[i], marcando o erro das linhas com overflow.
+        typedef void ( *kernel_t )( Token::value_type * a, const Token::value_type * b,
+                                    size_t n, std::uint8_t * err );
+
+        kernel_t k_add;          //<! Kernel da soma.
+        kernel_t k_sub;          //<! Kernel da subtração.
+        kernel_t k_mul;          //<! Kernel da multiplicação.
+        const char * nome_isa;   //<! Conjunto de instruções escolhido.
+
+        std::vector< Token::value_type > stack; //<! Pilha colunar: max_depth colunas de BLOCO valores.
+};
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * @file    bytecode.h
+ * @brief   Arquivo cabeçalho com o compilador de expressões postfix
+            para bytecode e a máquina virtual que o executa.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _BYTECODE_H_
+#define _BYTECODE_H_
+
+#include <vector>   // std::vector
+#include <memory_resource> // std::pmr::vector
+#include <cstdint>  // std::uint8_t
+#include <cstddef>  // size_t
+#include <ostream>  // std::ostream
+
+#include "token.h"  // struct Token.
+
+/**
+ *  Esse eh o struct EvalResult
+ *  Representa o resultado da avaliação de uma expressão.
+ */
+struct EvalResult
+{
+    // Lista de possíveis erros de execução.
+    enum code_t {
+            EVAL_OK = 0,
+            DIVISION_BY_ZERO,
+            NUMERIC_OVERFLOW
+    };
+
+    //=== Membros (public).
+    code_t type;              //<! Error code.
+    Token::value_type value;  //<! Valor da expressão (se não houve erro).
+
+    // Por padrão, o resultado é positivo.
+    explicit EvalResult( code_t type_=EVAL_OK, Token::value_type value_=0 )
+            : type{ type_ }
+            , value{ value_ }
+    { /* empty */ }
+};
+
+/**
+ *  Esse eh o struct Instruction
+ *  Uma instrução do bytecode: o código da operação e, para PUSH,
+ *  o operando imediato.
+ */
+struct Instruction
+{
+    /// Códigos de operação da máquina virtual.
+    enum class opcode_t : std::uint8_t
+    {
+        PUSH = 0,   //<! Empilha o imediato.
+        ADD,        //<! "+"
+        SUB,        //<! "-"
+        MUL,        //<! "*"
+        DIV,        //<! "/"
+        MOD,        //<! "%"
+        POW,        //<! "^"
+        SQR,        //<! "^2": eleva o topo da pilha ao quadrado (gerado pelo otimizador).
+        LOAD        //<! Empilha o valor da variável de índice imm.
+    };
+
+    Token::value_type imm;  //<! Operando imediato (PUSH) ou índice da variável (LOAD).
+    opcode_t op;            //<! Código da operação.
+};
+
+/**
+ *  Esse eh o struct Program
+ *  Expressão compilada: instruções em sequência mais a profundidade
+ *  máxima que a pilha de valores atinge durante a execução.
+ */
+struct Program
+{
+    std::pmr::vector< Instruction > code; //<! Instruções, na ordem de execução.
+    size_t max_depth;                     //<! Profundidade máxima da pilha.
+
+    /// As instruções são alocadas em mem_ (por padrão, no alocador global).
+    explicit Program( std::pmr::memory_resource * mem_ = std::pmr::get_default_resource() )
+        : code( mem_ )
+        , max_depth( 0 )
+    { /* empty */ }
+};
+
+/** @brief Compila uma expressão postfix para bytecode.
+    @param postfix_ Tokens da expressão no formato postfix.
+    @param prog_ Recebe o programa (o buffer de instruções é reaproveitado). */
+void compile( const TokenList & postfix_, Program & prog_ );
+
+/**
+ *  Essa eh a classe Optimizer
+ *  Passo de otimização entre a compilação e a execução: dobra as
+ *  sub-expressões constantes, aplica identidades algébricas (x*1, 1*x,
+ *  x+0, 0+x, x-0, x/1, x^1 e, quando x é um único operando, x*0 e 0*x)
+ *  e troca x^2 por SQR. Uma sub-expressão cuja avaliação dá erro nunca
+ *  é dobrada nem descartada, então o programa otimizado produz sempre
+ *  o mesmo valor ou o mesmo erro que o original.
+ */
+class Optimizer {
+    public:
+        /** @brief Otimiza um programa no próprio buffer de instruções.
+            @param prog_ Programa compilado (max_depth é recalculado).
+            @return Número de nós (instruções) removidos. */
+        size_t run( Program & prog_ );
+
+    private:
+        /// Sub-expressão já processada: onde começa o seu código e se é uma constante.
+        struct Node {
+            size_t begin;   //<! Índice da primeira instrução da sub-expressão.
+            bool constant;  //<! true se o código é um único PUSH.
+            bool unico;     //<! true se o código é um único operando (PUSH ou LOAD).
+        };
+
+        std::vector< Node > nodes;           //<! Pilha de sub-expressões.
+        std::vector< std::uint8_t > mortas;  //<! mortas[i]: a instrução i foi descartada.
+};
+
+/**
+ *  Essa eh a classe VM
+ *  Executa programas sobre uma pilha de valores pré-alocada, que só
+ *  cresce quando aparece um programa mais profundo que os anteriores.
+ */
+class VM {
+    public:
+        /** @brief Executa um programa.
+            @param prog_ Programa compilado.
+            @param vars_ Valor de cada variável, pelo índice (só é lido
+                   por programas com variáveis).
+            @return Resultado da avaliação. */
+        EvalResult run( const Program & prog_, const Token::value_type * vars_ = nullptr );
+
+        /** @brief Executa um programa mostrando cada operação realizada.
+            Caminho lento, usado apenas para depuração.
+            @param prog_ Programa compilado.
+            @param os_ Fluxo onde as operações são impressas.
+            @param vars_ Valor de cada variável, pelo índice.
+            @return Resultado da avaliação. */
+        EvalResult trace( const Program & prog_, std::ostream & os_, const Token::value_type * vars_ = nullptr );
+
+    private:
+        std::vector< Token::value_type > stack; //<! Pilha de valores.
+};
+
+#endif
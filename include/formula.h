@@ -0,0 +1,45 @@
+/**
+ * @file    formula.h
+ * @brief   Arquivo cabeçalho com a fórmula: uma expressão com variáveis
+            compilada uma única vez e avaliada para muitos valores.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _FORMULA_H_
+#define _FORMULA_H_
+
+#include <vector>      // std::vector
+#include <string>      // std::string
+#include <string_view> // std::string_view
+
+#include "bytecode.h" // Program.
+
+/**
+ *  Esse eh o struct Formula
+ *  Programa já compilado e otimizado de uma expressão com variáveis,
+ *  junto com o nome de cada variável. A instrução LOAD de índice i lê
+ *  o i-ésimo valor passado para a VM, na ordem de 'variables'.
+ */
+struct Formula{
+
+    public:
+
+        Program program;                      //<! Bytecode da expressão.
+        std::vector< std::string > variables; //<! Nome de cada variável, pelo índice.
+
+        /** @brief Procura o índice de uma variável.
+            @param name_ Nome da variável.
+            @return Índice da variável; -1 se ela não aparece na expressão. */
+        int slot( std::string_view name_ ) const
+        {
+            for( size_t i = 0; i < variables.size(); ++i )
+                if ( variables[i] == name_ )
+                    return i;
+            return -1;
+        }
+
+};
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file    mapped-file.h
+ * @brief   Arquivo cabeçalho com a leitura de arquivos via mmap, que
+            entrega as linhas como std::string_view sem copiar nada.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <vector>      // std::vector
+#include <string_view> // std::string_view
+#include <cstddef>     // size_t
+
+/**
+ *  Essa eh a classe MappedFile
+ *  Mapeia um arquivo inteiro na memória (somente leitura). As views
+ *  devolvidas por lines() apontam direto para o mapeamento e valem
+ *  enquanto o objeto existir.
+ */
+class MappedFile {
+    public:
+        /** @brief Mapeia o arquivo.
+            @param arq Nome do arquivo.
+            @return 1 se o arquivo foi mapeado; 0 otherwise. */
+        int open( const char * arq );
+
+        /** @brief Desfaz o mapeamento atual, se houver. */
+        void close( void );
+
+        /** @brief Recupera o conteúdo do arquivo.
+            @return View sobre todo o arquivo. */
+        std::string_view contents( void ) const;
+
+        /** @brief Divide o conteúdo em linhas (sem o '\n').
+            Segue a regra de leitura com getline: o trecho após o último
+            '\n', mesmo vazio, também é uma linha.
+            @param linhas_ Recebe uma view por linha. */
+        void lines( std::vector< std::string_view > & linhas_ ) const;
+
+        //==== Special methods
+        /// Constutor default.
+        MappedFile() = default;
+        ~MappedFile();
+        /// Desligar cópia e atribuição.
+        MappedFile( const MappedFile & ) = delete;  // Construtor cópia.
+        MappedFile & operator=( const MappedFile & ) = delete; // Atribuição.
+
+    private:
+        const char * data = nullptr; //<! Início do mapeamento.
+        size_t size = 0;             //<! Tamanho do arquivo, em bytes.
+};
+
+#endif
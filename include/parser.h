@@ -13,15 +13,21 @@
 #include <iostream> // cout, cin
 #include <iterator> // std::distance()
 #include <vector>   // std::vector
-#include <sstream>  // std::istringstream
+#include <string>   // std::string
+#include <string_view> // std::string_view
+#include <array>    // std::array
+#include <utility>  // std::move
 
 #include "token.h"  // struct Token.
 
 /*!
- * Implements a recursive descendent parser for a EBNF grammar.
+ * Implements a descendent parser for a EBNF grammar. Nested scopes are
+ * tracked with an explicit stack instead of native recursion.
  *
- *   <expr>            := <term>,{ ("+"|"-"),<term> };
- *   <term>            := <integer>;
+ *   <expr>            := <term>,{ ("+"|"-"|"*"|"/"|"%"|"^"),<term> };
+ *   <term>            := "(",<expr>,")" | <integer> | <identifier>;
+ *   <identifier>      := <letter>,{<letter>|<digit>};  (só com allow_variables)
+ *   <letter>          := "a"->"z" | "A"->"Z" | "_";
  *   <integer>         := 0 | ["-"],<natural_number>;
  *   <natural_number>  := <digit_excl_zero>,{<digit>};
  *   <digit_excl_zero> := "1" | "2" | "3" | "4" | "5" | "6" | "7" | "8" | "9";
@@ -70,13 +76,53 @@ class Parser {
         //==== Public interface
 
         /** @brief Realiza o parsing
+            A expressão não é copiada: o parser percorre a própria memória
+            apontada por e_, que precisa continuar válida durante a chamada.
+            Os tokens ficam no buffer interno, cuja capacidade é mantida
+            entre as chamadas.
             @param e_ Expressão.
             @return Resultado. */
-        ParserResult parse( std::string e_ );
+        ParserResult parse( std::string_view e_ );
 
-        /** @brief Recupera tokens.
+        /** @brief Realiza o parsing, gravando os tokens direto em out_.
+            out_ é esvaziado antes (a capacidade é aproveitada) e recebe
+            os tokens já extraídos mesmo se houver erro de sintaxe. O
+            buffer interno não é usado nesta chamada.
+            @param e_ Expressão.
+            @param out_ Buffer do chamador que recebe os tokens.
+            @return Resultado. */
+        ParserResult parse( std::string_view e_, TokenList & out_ );
+
+        /** @brief Recupera tokens da última chamada de parse( e_ ), sem cópia.
+            @return Lista de tokens (válida até a próxima chamada). */
+        const TokenList & get_tokens( void ) const { return token_list; }
+
+        /** @brief Entrega os tokens da última chamada de parse( e_ ) ao
+            chamador, por move. O buffer interno fica vazio e volta a
+            crescer na próxima chamada.
             @return Lista de tokens. */
-        std::vector< Token > get_tokens( void ) const;
+        TokenList take_tokens( void );
+
+        /** @brief Liga ou desliga a aceitação de variáveis (identificadores)
+            como operandos. Desligado por padrão: uma letra é um inteiro
+            mal formado, como sempre foi.
+            @param on_ true para aceitar variáveis. */
+        void allow_variables( bool on_ ){ variables_on = on_; }
+
+        /** @brief Liga ou desliga a saída direta no formato postfix.
+            Ligada, parse() já entrega os tokens em postfix (sem "(" e
+            ")"), numa única passada, sem a lista infix intermediária.
+            Desligada (o padrão), entrega os tokens em infix, como lidos,
+            o que é útil para depuração. Com erro de sintaxe, a saída
+            postfix fica incompleta.
+            @param on_ true para emitir postfix. */
+        void emit_postfix( bool on_ ){ postfix_on = on_; }
+
+        /** @brief Recupera os nomes das variáveis da última expressão.
+            O token VARIABLE guarda, em value, o índice do nome neste
+            vetor (a ordem é a da primeira ocorrência na expressão).
+            @return Nomes das variáveis. */
+        const std::vector< std::string > & get_variables( void ) const { return variables; }
 
         //==== Special methods
         /// Constutor default.
@@ -99,8 +145,11 @@ class Parser {
             TS_DIVISION,               //<! "/"
             TS_REST,                   //<! "%"
             TS_POTENTIATION,           //<! "^"
+            TS_OPENING_SCOPE,          //<! "("
+            TS_CLOSING_SCOPE,          //<! ")"
             TS_ZERO,                   //<! "0"
             TS_NON_ZERO_DIGIT,         //<! "1"->"9"
+            TS_LETTER,                 //<! "a"->"z", "A"->"Z", "_"
             TS_WS,                     //<! white-space
             TS_TAB,                    //<! tab
             TS_EOS,                    //<! End Of String
@@ -108,15 +157,33 @@ class Parser {
         };
 
         //==== Private members.
-        std::string expr;                    //<! A expressão a ser parsed
-        std::string::iterator it_curr_symb;  //<! Ponteiro para o atual char dentro da expressão.
-        std::vector< Token > token_list;     //<! Resultado da lista de tokens extraído da expressão.
+        std::string_view expr;                          //<! A expressão a ser parsed
+        std::string_view::const_iterator it_curr_symb;  //<! Ponteiro para o atual char dentro da expressão.
+        terminal_symbol_t curr_symb;                    //<! Classificação do char atual.
+        TokenList token_list;                //<! Buffer interno com os tokens extraídos da expressão.
+        TokenList * tokens_out = &token_list; //<! Destino dos tokens da chamada atual.
+        std::vector< Token::col_type > scopes; //<! Pilha com a coluna de cada '(' ainda aberto.
+        bool variables_on = false;           //<! Aceita identificadores como operandos.
+        bool postfix_on = false;             //<! Emite os tokens em postfix.
+        TokenList pending;                   //<! Operadores (e '(') à espera do operando da direita.
+        std::vector< std::string > variables; //<! Nomes das variáveis, na ordem de ocorrência.
+
+        static const std::array< terminal_symbol_t, 256 > char_class; //<! Classe de cada byte.
+
+        /** @brief Monta a tabela de classificação dos 256 valores de um byte.
+            @return Tabela com o código do símbolo terminal de cada byte. */
+        static constexpr std::array< terminal_symbol_t, 256 > make_char_class( void );
 
         /** @brief Converte de caractere para código do símbolo terminal.
             @param ch Caractere.
             @return Código do simbolo terminal. */
         terminal_symbol_t lexer( char ch ) const;
 
+        /** @brief Converte um simbolo terminal para o operador correspondente.
+            @param s_ Simbolo do terminal.
+            @return Código do operador (operator_t::NONE se não for operador). */
+        static Token::operator_t operator_of( terminal_symbol_t s_ );
+
         /** @brief Converte um simbolo terminal para a string correspondente.
 		    @param ch Caractere.
 		    @return Código do simbolo terminal. */
@@ -124,9 +191,16 @@ class Parser {
 
         //=== Support methods.
         
+        /** @brief Coluna do último caractere consumido.
+            @return Coluna (a partir de zero). */
+        Token::col_type prev_col( void ) const;
+
         /** @brief Iterador para avançar para próximo char na expressão. */
         void next_symbol( void );                
 
+        /** @brief Classifica o caractere atual (uma única vez por caractere). */
+        void classify( void );
+
         /** @brief Verifica se o símbolo atual é igual ao símbolo do terminal solicitado.
             @param s_ Simbolo do terminal.
             @return 1 se for igual 0 otherwise. */
@@ -149,11 +223,23 @@ class Parser {
             @return 1 se chegou 0 otherwise. */
         bool end_input( void ) const;     
 
-        /** @brief Converte um string em um integer.
-            @param ch Caractere .
-            @return Caractere no tipo inteiro. */ 
-        input_int_type str_to_int( std::string ch );
 
+        //=== Emissão de tokens (infix ou postfix).
+
+        /** @brief Emite um operador binário.
+            @param tk_ Token do operador. */
+        void emit_operator( const Token & tk_ );
+
+        /** @brief Emite um '('.
+            @param col_ Coluna do '('. */
+        void open_scope( Token::col_type col_ );
+
+        /** @brief Emite um ')'.
+            @param col_ Coluna do ')'. */
+        void close_scope( Token::col_type col_ );
+
+        /** @brief Emite os operadores pendentes no fim da expressão. */
+        void flush_operators( void );
 
         //=== NTS methods.
 
@@ -166,23 +252,20 @@ class Parser {
         ParserResult term();
 
         /** @brief Processa um inteiro.
+            O valor precisa caber em required_int_type; caso contrário o
+            resultado é INTEGER_OUT_OF_RANGE, apontando para o início do inteiro.
+            @param value_ Recebe o valor do inteiro.
             @return Resultado do processamento. */ 
-        ParserResult integer();
+        ParserResult integer( input_int_type & value_ );
+
+        /** @brief Processa um identificador, que vira um token VARIABLE.
+            @return Resultado do processamento. */
+        ParserResult identifier();
 
         /** @brief Processa um número natural.
+            @param value_ Recebe o valor do número.
             @return Resultado do processamento. */ 
-        ParserResult natural_number();
-
-
-        //=== Terminal methods - must return bool
-
-        /** @brief Verifica se número é 1...9.
-            @return 1 se for 0 otherwise. */
-        bool digit_excl_zero();
-
-        /** @brief Verifica se número é 0...9.
-            @return 1 se for 0 otherwise. */
-        bool digit();
+        ParserResult natural_number( input_int_type & value_ );
 };
 
 #endif
@@ -0,0 +1,106 @@
+/**
+ * @file    record.h
+ * @brief   Arquivo cabeçalho com o registro que acompanha cada linha
+            de entrada ao longo de todo o pipeline do bares.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include <vector>   // std::vector
+#include <memory_resource> // std::pmr::memory_resource
+#include <memory>   // std::destroy_at
+#include <new>      // placement new
+
+#include "token.h"  // struct Token.
+#include "parser.h" // classe Parser.
+#include "bytecode.h" // Program, EvalResult.
+
+/**
+ *  Esse eh o struct Record
+ *  Cada linha do arquivo de entrada gera um registro, preenchido uma
+ *  única vez por cada estágio (parsing, conversão e avaliação) e
+ *  consumido no final pelo estágio de escrita.
+ */
+struct Record{
+
+    public:
+
+        /**
+         *  Esse eh o enum status_t
+         *  Indica até onde a linha chegou no pipeline.
+         */
+        enum status_t : int
+        {
+            PENDING = 0,    //<! Ainda não avaliada.
+            SYNTAX_ERROR,   //<! Falhou no parser.
+            RUNTIME_ERROR,  //<! Falhou durante a avaliação.
+            EVALUATED       //<! Avaliada com sucesso.
+        };
+
+        status_t status;                //<! Situação da linha.
+        Parser::ParserResult result;    //<! Resultado do parser (código e coluna do erro).
+        TokenList tokens;               //<! Tokens no formato infix.
+        TokenList postfix;              //<! Tokens no formato postfix.
+        Program program;                //<! Expressão compilada para bytecode (já otimizada).
+        size_t removed_nodes;           //<! Nós removidos pelo otimizador.
+        Token::value_type value;        //<! Resultado da expressão.
+        EvalResult::code_t runtime_error; //<! Erro de execução, se houver.
+
+        /**
+         *  Esse eh o construtor padrão Record
+         *  Os tokens e o bytecode da linha são alocados em mem_ (a arena
+         *  do lote ao qual a linha pertence).
+         */
+        explicit Record( std::pmr::memory_resource * mem_ = std::pmr::get_default_resource() )
+            : status( PENDING )
+            , result()
+            , tokens( mem_ )
+            , postfix( mem_ )
+            , program( mem_ )
+            , removed_nodes( 0 )
+            , value( 0 )
+            , runtime_error( EvalResult::EVAL_OK )
+        {/* empty */}
+
+        /**
+         *  Volta ao estado inicial (PENDING), alocando em mem_. Na mesma
+         *  arena os buffers só são esvaziados e mantêm a capacidade; numa
+         *  arena diferente (linha roubada por outra thread, que tem a sua
+         *  própria arena) cada buffer passa a alocar na nova.
+         */
+        void reset( std::pmr::memory_resource * mem_ ){
+            status = PENDING;
+            result = Parser::ParserResult();
+            religar( tokens, mem_ );
+            religar( postfix, mem_ );
+            religar( program.code, mem_ );
+            program.max_depth = 0;
+            removed_nodes = 0;
+            value = 0;
+            runtime_error = EvalResult::EVAL_OK;
+        }
+
+    private:
+
+        /**
+         *  Esvazia um vetor pmr e o deixa alocando em mem_. O alocador de
+         *  um vetor pmr não muda por atribuição nem por swap, então, se o
+         *  memory_resource é outro, o vetor (vazio) é recriado no lugar.
+         */
+        template< typename V >
+        static void religar( V & v_, std::pmr::memory_resource * mem_ ){
+            if ( v_.get_allocator().resource() == mem_ ){
+                v_.clear();
+                return;
+            }
+            std::destroy_at( &v_ );
+            ::new ( static_cast< void * >( &v_ ) ) V( mem_ );
+        }
+
+};
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file    result-cache.h
+ * @brief   Arquivo cabeçalho com o cache de resultados do bares: guarda
+            o resultado de expressões já processadas, indexado pelo texto
+            da expressão com os espaços normalizados.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _RESULT_CACHE_H_
+#define _RESULT_CACHE_H_
+
+#include <list>          // std::list
+#include <string>        // std::string
+#include <string_view>   // std::string_view
+#include <unordered_map> // std::unordered_map
+#include <cstddef>       // size_t
+
+#include "record.h" // struct Record.
+
+/**
+ *  Essa eh a classe ResultCache
+ *  Cache de tamanho limitado com descarte do item usado há mais tempo
+ *  (LRU). A chave é a expressão sem os espaços iniciais e com cada
+ *  sequência de espaços/tabs trocada por um único espaço, o que não
+ *  muda o significado da expressão para o Parser. A coluna de um erro
+ *  de sintaxe é guardada em relação à chave e convertida de volta para
+ *  a coluna da linha original a cada acerto.
+ *
+ *  Não é thread-safe: cada thread usa o seu próprio cache.
+ */
+class ResultCache {
+    public:
+        /** @brief Cria um cache vazio.
+            @param capacidade_ Número máximo de expressões guardadas. */
+        explicit ResultCache( size_t capacidade_ );
+
+        /** @brief Procura a expressão no cache.
+            Em caso de acerto, preenche o registro com o estado final da
+            linha (erro de sintaxe com a coluna já ajustada, erro de
+            execução ou valor) sem passar pelo parser nem pela VM.
+            @param expr_ Expressão, como aparece na entrada.
+            @param rec_ Registro que recebe o resultado.
+            @param tokens_ Recebe, num acerto, o número de tokens que o
+                   parser produziu para a expressão (para o --stats).
+            @return true se a expressão estava no cache. */
+        bool lookup( std::string_view expr_, Record & rec_, size_t * tokens_ = nullptr );
+
+        /** @brief Guarda o resultado de uma expressão já processada.
+            Deve ser chamado logo após um lookup() sem acerto para a
+            mesma expressão, pois reaproveita a chave já normalizada.
+            @param expr_ Expressão, como aparece na entrada.
+            @param rec_ Registro com o resultado final da linha. */
+        void store( std::string_view expr_, const Record & rec_ );
+
+        /// Número de consultas com acerto.
+        size_t hits( void ) const { return n_hits; }
+        /// Número de consultas sem acerto.
+        size_t misses( void ) const { return n_misses; }
+        /// Número de expressões descartadas por falta de espaço.
+        size_t evictions( void ) const { return n_evictions; }
+        /// Número de expressões guardadas.
+        size_t size( void ) const { return ordem.size(); }
+
+        //==== Special methods
+        ResultCache( ResultCache && ) = default;
+        ResultCache & operator=( ResultCache && ) = default;
+        /// Desligar cópia: o índice aponta para as chaves da lista.
+        ResultCache( const ResultCache & ) = delete;
+        ResultCache & operator=( const ResultCache & ) = delete;
+
+    private:
+        /// Resultado guardado para uma expressão.
+        struct Entry {
+            std::string key;                  //<! Expressão normalizada.
+            Record::status_t status;          //<! SYNTAX_ERROR, RUNTIME_ERROR ou EVALUATED.
+            Parser::ParserResult result;      //<! Erro de sintaxe (coluna relativa à chave).
+            Token::value_type value;          //<! Valor da expressão.
+            EvalResult::code_t runtime_error; //<! Erro de execução.
+            size_t tokens;                    //<! Tokens produzidos pelo parser.
+        };
+
+        typedef std::list< Entry > list_type;
+
+        size_t capacidade;   //<! Número máximo de entradas.
+        list_type ordem;     //<! Entradas, da usada mais recentemente para a mais antiga.
+        std::unordered_map< std::string_view, list_type::iterator > indice; //<! Chave -> entrada.
+        std::string chave;   //<! Buffer da última chave normalizada.
+
+        size_t n_hits = 0;      //<! Consultas com acerto.
+        size_t n_misses = 0;    //<! Consultas sem acerto.
+        size_t n_evictions = 0; //<! Entradas descartadas.
+
+        /** @brief Normaliza a expressão em 'chave'.
+            @param expr_ Expressão original. */
+        void normalize( std::string_view expr_ );
+
+        /** @brief Converte uma coluna da chave para a coluna na expressão original.
+            @param expr_ Expressão original.
+            @param col_ Coluna na chave normalizada.
+            @return Coluna correspondente em expr_. */
+        static size_t original_col( std::string_view expr_, size_t col_ );
+
+        /** @brief Converte uma coluna da expressão original para a coluna na chave.
+            @param expr_ Expressão original.
+            @param col_ Coluna em expr_.
+            @return Coluna correspondente na chave normalizada. */
+        static size_t normalized_col( std::string_view expr_, size_t col_ );
+};
+
+#endif
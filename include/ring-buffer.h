@@ -0,0 +1,169 @@
+/**
+ * @file    ring-buffer.h
+ * @brief   Arquivo cabeçalho com as filas circulares sem lock que ligam
+            os estágios do pipeline.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+#include <atomic>  // std::atomic
+#include <memory>  // std::unique_ptr
+#include <cstddef> // size_t
+
+/**
+ * @brief Menor potência de 2 maior ou igual a n_ (no mínimo 2).
+ * @param n_ Capacidade pedida.
+ * @return Capacidade arredondada.
+ */
+inline size_t potencia_de_2( size_t n_ ){
+    size_t c = 2;
+    while ( c < n_ )
+        c <<= 1;
+    return c;
+}
+
+/**
+ *  Essa eh a classe SpscQueue
+ *  Fila circular de capacidade fixa para um único produtor e um único
+ *  consumidor. Cada lado escreve apenas no seu próprio índice, então
+ *  push e pop são só uma leitura e uma escrita atômicas.
+ */
+template< typename T >
+class SpscQueue {
+    public:
+        /** @brief Cria a fila.
+            @param capacidade_ Número mínimo de itens (arredondado para uma potência de 2). */
+        explicit SpscQueue( size_t capacidade_ )
+            : mascara( potencia_de_2( capacidade_ ) - 1 )
+            , itens( new T[ mascara + 1 ] )
+        { /* empty */ }
+
+        /** @brief Insere um item (só o produtor chama).
+            @param v_ Item.
+            @return false se a fila está cheia. */
+        bool try_push( const T & v_ ){
+            auto e = escrita.load( std::memory_order_relaxed );
+            if ( e - leitura.load( std::memory_order_acquire ) > mascara )
+                return false;
+            itens[ e & mascara ] = v_;
+            escrita.store( e + 1, std::memory_order_release );
+            return true;
+        }
+
+        /** @brief Retira um item (só o consumidor chama).
+            @param v_ Recebe o item.
+            @return false se a fila está vazia. */
+        bool try_pop( T & v_ ){
+            auto l = leitura.load( std::memory_order_relaxed );
+            if ( l == escrita.load( std::memory_order_acquire ) )
+                return false;
+            v_ = itens[ l & mascara ];
+            leitura.store( l + 1, std::memory_order_release );
+            return true;
+        }
+
+        /** @brief Número aproximado de itens na fila (para estatísticas).
+            @return Itens. */
+        size_t size_approx( void ) const {
+            return escrita.load( std::memory_order_relaxed ) - leitura.load( std::memory_order_relaxed );
+        }
+
+    private:
+        const size_t mascara;                        //<! Capacidade - 1.
+        std::unique_ptr< T[] > itens;                //<! Itens, em ordem circular.
+        alignas( 64 ) std::atomic< size_t > escrita{ 0 }; //<! Próxima posição de escrita (produtor).
+        alignas( 64 ) std::atomic< size_t > leitura{ 0 }; //<! Próxima posição de leitura (consumidor).
+};
+
+/**
+ *  Essa eh a classe MpmcQueue
+ *  Fila circular de capacidade fixa para vários produtores e vários
+ *  consumidores. Cada posição guarda um número de sequência que diz se
+ *  ela está livre para a volta atual do produtor ou pronta para o
+ *  consumidor; os índices são reservados com compare_exchange, sem lock.
+ */
+template< typename T >
+class MpmcQueue {
+    public:
+        /** @brief Cria a fila.
+            @param capacidade_ Número mínimo de itens (arredondado para uma potência de 2). */
+        explicit MpmcQueue( size_t capacidade_ )
+            : mascara( potencia_de_2( capacidade_ ) - 1 )
+            , celulas( new Celula[ mascara + 1 ] )
+        {
+            for( size_t i = 0; i <= mascara; ++i )
+                celulas[i].seq.store( i, std::memory_order_relaxed );
+        }
+
+        /** @brief Insere um item.
+            @param v_ Item.
+            @return false se a fila está cheia. */
+        bool try_push( const T & v_ ){
+            auto pos = cauda.load( std::memory_order_relaxed );
+            for( ;; ){
+                auto & c = celulas[ pos & mascara ];
+                auto seq = c.seq.load( std::memory_order_acquire );
+                auto dif = static_cast< std::ptrdiff_t >( seq ) - static_cast< std::ptrdiff_t >( pos );
+                if ( dif == 0 ){
+                    if ( cauda.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ){
+                        c.valor = v_;
+                        c.seq.store( pos + 1, std::memory_order_release );
+                        return true;
+                    }
+                }
+                else if ( dif < 0 )
+                    return false; // a posição ainda tem o item da volta anterior
+                else
+                    pos = cauda.load( std::memory_order_relaxed );
+            }
+        }
+
+        /** @brief Retira um item.
+            @param v_ Recebe o item.
+            @return false se a fila está vazia. */
+        bool try_pop( T & v_ ){
+            auto pos = cabeca.load( std::memory_order_relaxed );
+            for( ;; ){
+                auto & c = celulas[ pos & mascara ];
+                auto seq = c.seq.load( std::memory_order_acquire );
+                auto dif = static_cast< std::ptrdiff_t >( seq ) - static_cast< std::ptrdiff_t >( pos + 1 );
+                if ( dif == 0 ){
+                    if ( cabeca.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ){
+                        v_ = c.valor;
+                        c.seq.store( pos + mascara + 1, std::memory_order_release );
+                        return true;
+                    }
+                }
+                else if ( dif < 0 )
+                    return false; // o produtor ainda não escreveu esta posição
+                else
+                    pos = cabeca.load( std::memory_order_relaxed );
+            }
+        }
+
+        /** @brief Número aproximado de itens na fila (para estatísticas).
+            @return Itens. */
+        size_t size_approx( void ) const {
+            auto c = cauda.load( std::memory_order_relaxed );
+            auto h = cabeca.load( std::memory_order_relaxed );
+            return c > h ? c - h : 0;
+        }
+
+    private:
+        /// Uma posição da fila.
+        struct Celula {
+            std::atomic< size_t > seq; //<! Volta em que a posição está livre/pronta.
+            T valor;                   //<! Item.
+        };
+
+        const size_t mascara;                       //<! Capacidade - 1.
+        std::unique_ptr< Celula[] > celulas;        //<! Posições, em ordem circular.
+        alignas( 64 ) std::atomic< size_t > cauda{ 0 };  //<! Próxima posição de escrita.
+        alignas( 64 ) std::atomic< size_t > cabeca{ 0 }; //<! Próxima posição de leitura.
+};
+
+#endif
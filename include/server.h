@@ -0,0 +1,112 @@
+/**
+ * @file    server.h
+ * @brief   Arquivo cabeçalho com o modo servidor do bares: avalia
+            expressões recebidas por um socket Unix local.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <vector>    // std::vector
+#include <string>    // std::string
+#include <memory>    // std::unique_ptr
+#include <streambuf> // std::streambuf
+#include <ostream>   // std::ostream
+#include <cstddef>   // size_t
+
+#include "bares-manager.h" // classe BaresManager.
+
+/**
+ *  Essa eh a classe Server
+ *  Servidor de uma única thread sobre um socket Unix (SOCK_STREAM),
+ *  com um laço de eventos epoll. Cada cliente envia expressões
+ *  terminadas por '\n' e recebe, na mesma ordem, uma linha por
+ *  expressão no formato de resultados.txt. O cliente pode mandar várias
+ *  expressões sem esperar as respostas (pipelining): tudo que chega
+ *  numa leitura é avaliado e respondido num único envio.
+ *
+ *  O servidor para com SIGINT ou SIGTERM, removendo o socket.
+ */
+class Server {
+    public:
+        /** @brief Cria o servidor.
+            @param manager_ Gerenciador que avalia as expressões. */
+        explicit Server( BaresManager & manager_ );
+        ~Server();
+
+        /** @brief Cria o socket e começa a escutar.
+            @param caminho_ Caminho do socket (um socket que já exista
+                   no caminho é substituído).
+            @return 1 se o socket foi criado; 0 otherwise. */
+        int open( const char * caminho_ );
+
+        /** @brief Atende os clientes até receber SIGINT ou SIGTERM.
+            @return 1 se o servidor parou normalmente; 0 otherwise. */
+        int run( void );
+
+        //==== Special methods
+        /// Desligar cópia e atribuição.
+        Server( const Server & ) = delete;  // Construtor cópia.
+        Server & operator=( const Server & ) = delete; // Atribuição.
+
+    private:
+        static constexpr size_t TAMANHO_LEITURA = 1 << 16;  //<! bytes por chamada de read()
+        static constexpr size_t LIMITE_LINHA = 1 << 24;     //<! maior linha aceita, em bytes
+        static constexpr size_t LIMITE_SAIDA = 1 << 20;     //<! respostas pendentes antes de parar de ler
+
+        /// Buffer de saída que acrescenta o texto numa std::string.
+        class Acumulador : public std::streambuf {
+            public:
+                std::string * destino = nullptr; //<! String que recebe o texto.
+            protected:
+                int_type overflow( int_type ch_ ) override;
+                std::streamsize xsputn( const char * s_, std::streamsize n_ ) override;
+        };
+
+        /// Estado de um cliente conectado.
+        struct Conexao {
+            int fd;                  //<! Socket do cliente.
+            std::string entrada;     //<! Bytes recebidos que ainda não formam uma linha completa.
+            std::string saida;       //<! Respostas ainda não enviadas.
+            size_t enviado = 0;      //<! Bytes de saida já enviados.
+            unsigned eventos = 0;    //<! Eventos registrados no epoll.
+            bool fechando = false;   //<! O cliente fechou a escrita: enviar o resto e fechar.
+        };
+
+        BaresManager & manager;        //<! Avalia as expressões.
+        std::string caminho;           //<! Caminho do socket.
+        int fd_escuta = -1;            //<! Socket que aceita as conexões.
+        int fd_epoll = -1;             //<! Instância do epoll.
+        int fd_sinais = -1;            //<! signalfd de SIGINT e SIGTERM.
+        std::vector< std::unique_ptr< Conexao > > conexoes; //<! Clientes, indexados pelo fd.
+        std::vector< char > leitura;   //<! Buffer de read().
+        Acumulador acumulador;         //<! Buffer de saida das respostas.
+        std::ostream respostas;        //<! Fluxo sobre o acumulador.
+
+        /** @brief Aceita todas as conexões pendentes. */
+        void aceitar( void );
+
+        /** @brief Lê o que o cliente enviou e avalia as linhas completas.
+            @param c Cliente.
+            @return false se a conexão caiu. */
+        bool ler( Conexao & c );
+
+        /** @brief Envia as respostas pendentes do cliente.
+            @param c Cliente.
+            @return false se a conexão caiu. */
+        bool enviar( Conexao & c );
+
+        /** @brief Ajusta os eventos do cliente no epoll: para de ler
+            enquanto houver respostas demais à espera do envio.
+            @param c Cliente. */
+        void atualizarEventos( Conexao & c );
+
+        /** @brief Fecha a conexão e descarta o estado do cliente.
+            @param c Cliente. */
+        void fechar( Conexao & c );
+};
+
+#endif
@@ -0,0 +1,162 @@
+/**
+ * @file    stats.h
+ * @brief   Arquivo cabeçalho com a instrumentação do bares: tempo de
+            cada estágio, contadores e histogramas de latência.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <cstdint>  // std::uint64_t
+#include <ostream>  // std::ostream
+#include <mutex>    // std::mutex
+#include <chrono>   // std::chrono::steady_clock
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h> // __rdtsc
+#endif
+
+#include "parser.h"   // Parser::ParserResult.
+#include "bytecode.h" // EvalResult.
+
+// Liga a instrumentação no build (o CMake define BARES_STATS=0 com
+// -DBARES_STATS=OFF). Desligada, Stats::coletor() é sempre nullptr e
+// todo o código de coleta some na compilação.
+#ifndef BARES_STATS
+#define BARES_STATS 1
+#endif
+
+/**
+ *  Essa eh a classe Stats
+ *  Coleta, quando ligada por --stats, o tempo de cada estágio, o número
+ *  de expressões, tokens e alocações, os erros por código e um
+ *  histograma (em escala log2) do tempo de parsing e de avaliação de
+ *  cada expressão. Os tempos são medidos em ticks (rdtsc, ou
+ *  steady_clock fora do x86) e convertidos para ns só no relatório.
+ *
+ *  Cada thread coleta nos seus próprios contadores (um objeto Coleta
+ *  no início da thread), somados ao total quando ela termina: não há
+ *  atomics nem locks no caminho de cada expressão.
+ */
+class Stats {
+    public:
+        //=== Alias
+        typedef std::uint64_t ticks_t; //<! Unidade de tempo das medições.
+
+        /// Estágios medidos.
+        enum estagio_t {
+            INITIALIZE = 0,  //<! initialize()
+            VALIDAR,         //<! validarExpress()
+            CONVERTER,       //<! converterExpress() (infix_to_postfix)
+            AVALIAR,         //<! avaliarExpress() (evaluate_postfix)
+            APRESENTAR,      //<! apresentarConsole() e apresentarResult()
+            PARALELO,        //<! processarParalelo()
+            STREAM,          //<! processarStream()
+            PIPELINE,        //<! processarPipeline()
+            BINDINGS,        //<! processarBindings()
+            N_ESTAGIOS
+        };
+
+        static constexpr int N_BALDES = 64;  //<! Baldes do histograma (um por potência de 2).
+        static constexpr int N_ERROS_SINTAXE = Parser::ParserResult::MISSING_CLOSING_PARENTHESIS + 1;
+        static constexpr int N_ERROS_EXECUCAO = EvalResult::NUMERIC_OVERFLOW + 1;
+
+        /// Histograma em escala log2: o balde i conta as medições em [2^i, 2^(i+1)).
+        struct Histograma {
+            std::uint64_t baldes[ N_BALDES ] = {}; //<! Medições por balde.
+
+            /** @brief Conta uma medição.
+                @param t_ Duração, em ticks. */
+            void add( ticks_t t_ ){ ++baldes[ t_ ? 63 - __builtin_clzll( t_ ) : 0 ]; }
+        };
+
+        /// Contadores de uma thread (ou o total).
+        struct Contadores {
+            ticks_t ticks[ N_ESTAGIOS ] = {};               //<! Tempo em cada estágio.
+            std::uint64_t chamadas[ N_ESTAGIOS ] = {};      //<! Chamadas de cada estágio.
+            std::uint64_t expressoes = 0;                   //<! Expressões processadas.
+            std::uint64_t tokens = 0;                       //<! Tokens produzidos pelo parser.
+            std::uint64_t alocacoes = 0;                    //<! Chamadas ao operator new.
+            std::uint64_t erros_sintaxe[ N_ERROS_SINTAXE ] = {};   //<! Por Parser::ParserResult::code_t.
+            std::uint64_t erros_execucao[ N_ERROS_EXECUCAO ] = {}; //<! Por EvalResult::code_t.
+            Histograma parse;                               //<! Tempo de parsing por expressão.
+            Histograma eval;                                //<! Tempo de avaliação por expressão.
+
+            /** @brief Soma outros contadores a estes.
+                @param o_ Contadores a somar. */
+            void somar( const Contadores & o_ );
+        };
+
+        /**
+         *  Contadores de uma thread, do construtor ao destrutor. Sem
+         *  --stats não faz nada.
+         */
+        class Coleta {
+            public:
+                Coleta();
+                ~Coleta();
+                Coleta( const Coleta & ) = delete;
+                Coleta & operator=( const Coleta & ) = delete;
+            private:
+                Contadores local;                 //<! Contadores desta thread.
+                Contadores * anterior = nullptr;  //<! Coletor que estava ativo antes.
+                bool ligada = false;              //<! A coleta está ativa.
+        };
+
+        /**
+         *  Mede o tempo de um estágio, do construtor ao destrutor.
+         */
+        class Estagio {
+            public:
+                explicit Estagio( estagio_t e_ )
+                    : e( e_ )
+                    , inicio( coletor() ? agora() : 0 )
+                { /* empty */ }
+                ~Estagio(){
+                    if ( auto c = coletor() ){
+                        c->ticks[e] += agora() - inicio;
+                        ++c->chamadas[e];
+                    }
+                }
+                Estagio( const Estagio & ) = delete;
+                Estagio & operator=( const Estagio & ) = delete;
+            private:
+                estagio_t e;    //<! Estágio medido.
+                ticks_t inicio; //<! Início da medição.
+        };
+
+        /** @brief Liga a coleta (--stats). Chamar antes de criar threads. */
+        static void ligar( void );
+
+        /** @brief Contadores da thread atual.
+            @return Contadores, ou nullptr se a coleta está desligada. */
+        static Contadores * coletor( void ){ return BARES_STATS ? atual : nullptr; }
+
+        /** @brief Instante atual, em ticks.
+            @return Ticks. */
+        static ticks_t agora( void ){
+#if defined( __x86_64__ ) || defined( __i386__ )
+            return __rdtsc();
+#else
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        }
+
+        /** @brief Escreve o total coletado (de todas as threads já
+            terminadas e da atual) em JSON.
+            @param saida_ Fluxo de saída. */
+        static void escreverJson( std::ostream & saida_ );
+
+    private:
+        static bool ativo;                          //<! --stats foi pedido.
+        static inline thread_local Contadores * atual = nullptr; //<! Contadores da thread.
+        static Contadores total;                    //<! Soma das threads terminadas.
+        static std::mutex trava;                    //<! Protege total.
+        static ticks_t inicio_ticks;                //<! Ticks em ligar().
+        static std::chrono::steady_clock::time_point inicio_relogio; //<! Relógio em ligar().
+};
+
+#endif
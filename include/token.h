@@ -10,12 +10,15 @@
 #ifndef _TOKEN_H_
 #define _TOKEN_H_
 
-#include <string>   // std::string
+#include <cstdint>  // std::uint8_t, std::uint32_t
 #include <iostream> // std::ostream
+#include <memory_resource> // std::pmr::vector
 
 /**
  *  Esse eh o struct Token
- *  Aqui sao definidas variáveis bases para  a tokenização
+ *  Aqui sao definidas variáveis bases para  a tokenização.
+ *  O token é compacto e não aloca memória: operandos guardam o valor
+ *  inteiro já convertido e operadores guardam apenas um código.
  */
 struct Token{
 
@@ -25,33 +28,130 @@ struct Token{
          *  Esse eh o enum token_t
          *  Aqui é denominado o operando e operator
          */
-        enum class token_t : int
+        enum class token_t : std::uint8_t
         {
-            OPERAND = 0,  // Basically numbers.
-            OPERATOR      // "+", "-".
+            OPERAND = 0,    // Basically numbers.
+            OPERATOR,       // "+", "-".
+            OPENING_SCOPE,  // "("
+            CLOSING_SCOPE,  // ")"
+            VARIABLE        // Identificadores; value guarda o índice da variável.
         };
 
-        std::string value; //<! O valor original do token.
+        /**
+         *  Esse eh o enum operator_t
+         *  Código de cada operador suportado.
+         */
+        enum class operator_t : std::uint8_t
+        {
+            NONE = 0,         //<! Não é operador.
+            PLUS,             //<! "+"
+            MINUS,            //<! "-"
+            MULTIPLICATION,   //<! "*"
+            DIVISION,         //<! "/"
+            REST,             //<! "%"
+            POTENTIATION      //<! "^"
+        };
+
+        //=== Alias
+        typedef long long int value_type; //<! Tipo do valor de um operando.
+        typedef std::uint32_t col_type;   //<! Usado para locação da coluna.
+
+        value_type value;  //<! O valor do operando, já convertido.
         token_t type;      //<! O tipo do token.
+        operator_t op;     //<! O código do operador.
+        col_type col;      //<! Coluna do token na expressão original.
 
         /**
-         *  Esse eh o construtor padrão Token
+         *  Esse eh o construtor de operandos
          */
-        explicit Token( std::string v_="", token_t t_ = token_t::OPERAND )
+        explicit Token( value_type v_=0, col_type c_=0 )
+            : value( v_ )
+            , type( token_t::OPERAND )
+            , op( operator_t::NONE )
+            , col( c_ )
+        {/* empty */}
+
+        /**
+         *  Esse eh o construtor de operadores
+         */
+        explicit Token( operator_t o_, col_type c_=0 )
+            : value( 0 )
+            , type( token_t::OPERATOR )
+            , op( o_ )
+            , col( c_ )
+        {/* empty */}
+
+        /**
+         *  Esse eh o construtor de parênteses e variáveis
+         */
+        explicit Token( token_t t_, col_type c_=0, value_type v_=0 )
             : value( v_ )
             , type( t_ )
+            , op( operator_t::NONE )
+            , col( c_ )
         {/* empty */}
 
+        /// Converte um código de operador para o caractere correspondente.
+        static char symbol( operator_t o_ )
+        {
+            switch( o_ )
+            {
+                case operator_t::PLUS           : return '+';
+                case operator_t::MINUS          : return '-';
+                case operator_t::MULTIPLICATION : return '*';
+                case operator_t::DIVISION       : return '/';
+                case operator_t::REST           : return '%';
+                case operator_t::POTENTIATION   : return '^';
+                default                         : return '?';
+            }
+        }
+
+        /// Precedência de um operador (maior liga mais forte); "(" e
+        /// operator_t::NONE ficam com 0. Tabela única do parser e de
+        /// BaresManager::infix_to_postfix().
+        static int precedence( operator_t o_ )
+        {
+            switch( o_ )
+            {
+                case operator_t::POTENTIATION   : return 3;
+                case operator_t::MULTIPLICATION :
+                case operator_t::DIVISION       :
+                case operator_t::REST           : return 2;
+                case operator_t::PLUS           :
+                case operator_t::MINUS          : return 1;
+                default                         : return 0;
+            }
+        }
+
+        /// Verifica se o operador associa à direita (só "^").
+        static bool right_associative( operator_t o_ )
+        {
+            return o_ == operator_t::POTENTIATION;
+        }
+
         /// Apenas para ajudar a debug o codigo.
         friend std::ostream & operator<<( std::ostream& os_, const Token & t_ )
         {
-            std::string types[] = { "OPERAND", "OPERATOR" };
+            static const char * types[] = { "OPERAND", "OPERATOR", "OPENING_SCOPE", "CLOSING_SCOPE", "VARIABLE" };
 
-            os_ << "<" << t_.value << "," << types[(int)(t_.type)] << ">";
+            os_ << "<";
+            if ( t_.type == token_t::OPERAND )
+                os_ << t_.value;
+            else if ( t_.type == token_t::VARIABLE )
+                os_ << "$" << t_.value;
+            else if ( t_.type == token_t::OPERATOR )
+                os_ << symbol( t_.op );
+            else
+                os_ << ( t_.type == token_t::OPENING_SCOPE ? '(' : ')' );
+            os_ << "," << types[(int)(t_.type)] << ">";
 
             return os_;
         }
 
 };
 
+/// Lista de tokens. A memória vem de um std::pmr::memory_resource: a
+/// arena do lote, nos registros, ou o alocador global, por padrão.
+typedef std::pmr::vector< Token > TokenList;
+
 #endif
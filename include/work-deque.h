@@ -0,0 +1,76 @@
+/**
+ * @file    work-deque.h
+ * @brief   Arquivo cabeçalho com a deque de tarefas de cada worker do
+            escalonador com roubo de trabalho.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#ifndef _WORK_DEQUE_H_
+#define _WORK_DEQUE_H_
+
+#include <vector>  // std::vector
+#include <mutex>   // std::mutex, std::lock_guard
+#include <cstddef> // size_t
+
+/**
+ *  Essa eh a classe WorkDeque
+ *  Deque de tarefas de um worker. O dono empilha e desempilha pelo fim
+ *  (a tarefa mais recente, ainda quente na cache); os outros workers
+ *  roubam pelo início, onde ficam as tarefas mais antigas, que são as
+ *  maiores. Todas as operações (push, pop e steal) usam o mesmo mutex,
+ *  então o dono e qualquer número de ladrões disputam por ele; cada
+ *  operação é curta e uma tarefa vale um pedaço inteiro de linhas, o
+ *  que mantém a disputa baixa. A capacidade é mantida entre os usos.
+ */
+template< typename T >
+class WorkDeque {
+    public:
+        /** @brief Empilha uma tarefa (só o dono chama).
+            @param t_ Tarefa. */
+        void push( const T & t_ ){
+            std::lock_guard< std::mutex > lk( trava );
+            itens.push_back( t_ );
+        }
+
+        /** @brief Desempilha a tarefa mais recente (só o dono chama).
+            @param t_ Recebe a tarefa.
+            @return false se a deque está vazia. */
+        bool pop( T & t_ ){
+            std::lock_guard< std::mutex > lk( trava );
+            if ( inicio == itens.size() )
+                return false;
+            t_ = itens.back();
+            itens.pop_back();
+            compactar();
+            return true;
+        }
+
+        /** @brief Rouba a tarefa mais antiga (chamado pelos outros workers).
+            @param t_ Recebe a tarefa.
+            @return false se a deque está vazia. */
+        bool steal( T & t_ ){
+            std::lock_guard< std::mutex > lk( trava );
+            if ( inicio == itens.size() )
+                return false;
+            t_ = itens[ inicio++ ];
+            compactar();
+            return true;
+        }
+
+    private:
+        std::mutex trava;       //<! Protege itens e inicio.
+        std::vector< T > itens; //<! Tarefas; as válidas são [inicio, size()).
+        size_t inicio = 0;      //<! Primeira tarefa ainda não roubada.
+
+        /// Vazia: volta ao começo do vetor, mantendo a capacidade.
+        void compactar( void ){
+            if ( inicio == itens.size() ){
+                itens.clear();
+                inicio = 0;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file    alocacoes.cpp
+ * @brief   Código fonte do alocador global com contagem de alocações.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <atomic>  // std::atomic
+#include <cstdlib> // malloc, free
+#include <new>     // std::bad_alloc
+
+#include "alocacoes.h" // ligarContagemGlobal, alocacoesGlobais.
+#include "stats.h"     // classe Stats.
+
+
+static bool global = false;                          //<! ligarContagemGlobal() foi chamada.
+static std::atomic< unsigned long long > total( 0 ); //<! Alocações do processo.
+
+/** @brief Passa a contar todas as alocações do processo. */
+void ligarContagemGlobal( void ){
+    global = true;
+}
+
+/// Alocações contadas desde ligarContagemGlobal().
+unsigned long long alocacoesGlobais( void ){
+    return total.load( std::memory_order_relaxed );
+}
+
+// Fora de linha: se o compilador expandir estas funções nos
+// chamadores, ele passa a ver free() sobre ponteiros de operator new.
+__attribute__(( noinline )) void * operator new( size_t n ){
+    if ( auto c = Stats::coletor() )
+        ++c->alocacoes;
+    if ( global )
+        total.fetch_add( 1, std::memory_order_relaxed );
+    if ( void * p = std::malloc( n ? n : 1 ) )
+        return p;
+    throw std::bad_alloc();
+}
+void * operator new[]( size_t n ){ return operator new( n ); }
+__attribute__(( noinline )) void operator delete( void * p ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete[]( void * p ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete( void * p, size_t ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete[]( void * p, size_t ) noexcept { std::free( p ); }
@@ -0,0 +1,63 @@
+/**
+ * @file    arena.cpp
+ * @brief   Código fonte da arena de memória dos registros.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <algorithm> // std::max
+#include <cstdint>   // std::uintptr_t
+
+#include "arena.h" // classe Arena.
+
+
+/** @brief Cria uma arena vazia (nenhum bloco é alocado ainda).
+    @param bloco_ Tamanho do primeiro bloco, em bytes. */
+Arena::Arena( size_t bloco_ )
+    : primeiro( bloco_ )
+{ /* empty */ }
+
+/** @brief Libera, de uma vez, tudo que foi alocado na arena.
+    Os blocos são mantidos para os próximos lotes. */
+void Arena::reset( void ){
+    atual = 0;
+    usado = 0;
+}
+
+/** @brief Memória reservada pela arena (soma dos blocos).
+    @return Capacidade, em bytes. */
+size_t Arena::capacity( void ) const {
+    size_t total = 0;
+    for( const auto & b : blocos )
+        total += b.tamanho;
+    return total;
+}
+
+/** @brief Aloca avançando o ponteiro do bloco atual.
+    @param bytes_ Tamanho pedido.
+    @param align_ Alinhamento pedido.
+    @return Ponteiro para a memória. */
+void * Arena::do_allocate( size_t bytes_, size_t align_ ){
+
+    // Procura, a partir do bloco atual, o primeiro com espaço suficiente.
+    while ( atual < blocos.size() ){
+        auto base = reinterpret_cast< std::uintptr_t >( blocos[atual].dados.get() );
+        auto inicio = ( base + usado + align_ - 1 ) & ~std::uintptr_t( align_ - 1 );
+        if ( inicio + bytes_ <= base + blocos[atual].tamanho ){
+            usado = inicio + bytes_ - base;
+            return reinterpret_cast< void * >( inicio );
+        }
+        ++atual;
+        usado = 0;
+    }
+
+    // Nenhum bloco serve: um novo, com o dobro do último (no mínimo o pedido).
+    size_t tamanho = blocos.empty() ? primeiro : 2 * blocos.back().tamanho;
+    tamanho = std::max( tamanho, bytes_ + align_ );
+    blocos.push_back( Bloco{ std::unique_ptr< std::byte[] >( new std::byte[ tamanho ] ), tamanho } );
+    atual = blocos.size() - 1;
+    usado = 0;
+
+    return do_allocate( bytes_, align_ );
+}
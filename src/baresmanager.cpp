@@ -20,7 +20,7 @@
  * @param result Resultado do parser.
  * @param str String com expressão
  */
-void print_msg( const Parser::ParserResult & result, std::string str ){
+void print_msg( const Parser::ParserResult & result, std::string_view str ){
     std::string error_indicator( str.size()+1, ' ');
 
     // Have we got a parsing error?
@@ -51,17 +51,13 @@ void print_msg( const Parser::ParserResult & result, std::string str ){
     }
 
     std::cout << "\"" << str << "\"\n";
-    std::cout << " " << error_indicator << std::endl;
+    std::cout << " " << error_indicator << "\n";
 }
 
 /** @brief Apresenta mensagem final das expressões com erro de sintaxe.
-    @param cont Contador
     @param arqsaida Arquivo de saída dos resultados
     @param result O resultado do Parser */
-void BaresManager::message( int cont, std::ofstream & arqsaida, const Parser::ParserResult & result ){
-
-    int tam = expressions[cont].size();
-    std::cout << tam << "\n";
+void BaresManager::message( std::ostream & arqsaida, const Parser::ParserResult & result ){
 
     switch ( result.type )
     {
@@ -92,12 +88,12 @@ void BaresManager::message( int cont, std::ofstream & arqsaida, const Parser::Pa
 
 
 /**
- * @brief Verifica se token é um operando.
+ * @brief Verifica se token é um operando (constante ou variável).
  * @param t Token.
  * @return 1 se é operando 0 otherwise
  */
 bool is_operand( const Token & t ){
-    return t.type == Token::token_t::OPERAND;
+    return t.type == Token::token_t::OPERAND or t.type == Token::token_t::VARIABLE;
 }
 
 /**
@@ -109,61 +105,18 @@ bool is_operator( const Token & t ){
     return t.type == Token::token_t::OPERATOR;
 }
 
-/**
- * @brief Verifica a prioridade do operador passado por parametro.
- * @param c operador.
- * @return valor de prioridade.
- */
-int get_precedence( char c )
-{
-    int weight(0);
-    switch( c )
-    {
-        case '^': weight = 3;
-                  break;
-        // ==================================================
-        case '*':
-        case '%':
-        case '/': weight = 2;
-                  break;
-        // ==================================================
-        case '+':
-        case '-': weight = 1;
-                  break;
-        // ==================================================
-        case '(':
-                  weight = 0;
-                  break;
-        // ==================================================
-        default:
-            /* Empty */;
-    }
-
-    return weight;
-}
-
-/**
- * @brief Verifica se operador é potenciação ou não.
- * @param op operador.
- * @return 1 se é potencia 0 otherwise.
- */
-bool is_right_association( char op )
-{
-    return op == '^';
-}
-
 /**
  * @brief Determina se o primeiro operador é maior do que o segundo operador.
  * @param op1 Primeiro operador para comparação.
  * @param op2 Segundo operador para comparação.
  * @return 1 se op1 >= op2 0 otherwise.
  */
-bool has_higher_precedence( char op1, char op2 ) {
-    auto p1 = get_precedence( op1 );
-    auto p2 = get_precedence( op2 );
+bool has_higher_precedence( Token::operator_t op1, Token::operator_t op2 ) {
+    auto p1 = Token::precedence( op1 );
+    auto p2 = Token::precedence( op2 );
 
     // special case: has the same precedence and is right association.
-    if ( p1 == p2 and is_right_association( op1 ) )
+    if ( p1 == p2 and Token::right_associative( op1 ) )
     {
         return false;
     }
@@ -172,78 +125,83 @@ bool has_higher_precedence( char op1, char op2 ) {
 }
 
 /**
- * @brief Executa uma operação.
- * @param n1 Primeiro número inteiro para a operação.
- * @param n2 Segundo número inteiro para a operação.
- * @param opr Operador da operação.
- * @return Resultado da operação.
+ * @brief Converte um erro de execução para a mensagem correspondente.
+ * @param code Código do erro.
+ * @return Mensagem do erro.
  */
-long int execute_operator( long int  n1, long int  n2, char opr ){
-
-    long int  result(0);
-    switch ( opr )
+const char * runtime_msg( EvalResult::code_t code ){
+    switch ( code )
     {
-        case '^' : result = static_cast<long int >( pow( n1, n2 ) );
-                   break;
-        case '*' : result =  n1 * n2;
-                   break;
-        case '/' : if ( n2 == 0 )
-                       throw std::runtime_error( "Division by zero" );
-                   result = n1/n2;
-                   break;
-        case '%' : if ( n2 == 0 )
-                       throw std::runtime_error( "Division by zero" );
-                   result = n1%n2;
-                   break;
-        case '+' : result = n1 + n2;
-                   break;
-        case '-' : result =  n1 - n2;
-                   break;
-        default: assert(false);
+        case EvalResult::DIVISION_BY_ZERO: return "Division by zero";
+        case EvalResult::NUMERIC_OVERFLOW: return "Numeric overflow";
+        default:                           return "Unhandled runtime error";
     }
-
-    return result;
-
 }
 
 /**
- * @brief Transforma um char em inteiro.
- * @param ch Char que será transformado em inteiro.
- * @return Valor inteiro equivalente ao char passado.
+ * @brief Conta o parsing de uma expressão (com --stats).
+ * @param c Contadores da thread.
+ * @param inicio Ticks no início do parsing.
+ * @param rec Registro da expressão, já com o resultado do parser.
+ * @param tokens Número de tokens produzidos.
  */
-long int char2integer( std::string ch ){
-
-    int tam = ch.size();
-    int val = 0;
-
-    long int num;
-
-    if( ch[0] == '-' ){
-    	int menos = 1;
-    	int cnt = 1;
-    	while( ch[cnt] == '-' ){
-    		menos += 1;
-    		cnt += 1;
-    	}
-    	for( auto i( std::begin(ch)+menos ) ; i != std::end(ch) ; i++ ){
-	        num = *i - '0';
-	        int dec = pow( 10, (tam-1-menos) );
+void contarParse( Stats::Contadores & c, Stats::ticks_t inicio, const Record & rec, size_t tokens ){
+    c.parse.add( Stats::agora() - inicio );
+    ++c.expressoes;
+    c.tokens += tokens;
+    ++c.erros_sintaxe[ rec.result.type ];
+}
 
-	        val += num*dec;
-	        tam --;
-	    }
-	    return val*pow((-1), menos);
-    } else {
-    	for( auto i( std::begin(ch) ) ; i != std::end(ch) ; i++ ){
-	        num = *i - '0';
-	        int dec = pow( 10, (tam-1) );
+/**
+ * @brief Conta a avaliação de uma expressão (com --stats).
+ * @param c Contadores da thread.
+ * @param inicio Ticks no início da avaliação (bytecode, otimização e VM).
+ * @param rec Registro da expressão, já avaliada.
+ */
+void contarEval( Stats::Contadores & c, Stats::ticks_t inicio, const Record & rec ){
+    c.eval.add( Stats::agora() - inicio );
+    if ( rec.status == Record::RUNTIME_ERROR )
+        ++c.erros_execucao[ rec.runtime_error ];
+}
 
-	        val += num*dec;
-	        tam --;
-	    }
-	    return val;
+/**
+ * @brief Consulta o cache de resultados, contando um acerto como uma
+ * expressão processada (com --stats): o tempo da consulta entra no
+ * histograma de parsing e, se a expressão é válida, a avaliação conta
+ * com tempo (quase) zero, como se a linha tivesse passado pela VM.
+ * @param cache Cache da thread.
+ * @param expr Expressão.
+ * @param rec Registro da linha.
+ * @return true se a expressão estava no cache.
+ */
+bool consultarCache( ResultCache & cache, std::string_view expr, Record & rec ){
+    auto stats = Stats::coletor();
+    auto inicio = stats ? Stats::agora() : 0;
+    size_t tokens = 0;
+    if ( not cache.lookup( expr, rec, &tokens ) )
+        return false;
+    if ( stats ){
+        contarParse( *stats, inicio, rec, tokens );
+        if ( rec.status != Record::SYNTAX_ERROR )
+            contarEval( *stats, Stats::agora(), rec );
     }
+    return true;
+}
 
+/**
+ * @brief Espera curta de um estágio do pipeline cuja fila está vazia
+ * (ou cheia): primeiro tenta de novo em seguida, depois cede a CPU e,
+ * numa espera longa (entrada lenta, por exemplo), dorme um pouco.
+ * @param tentativas Tentativas seguidas sem sucesso (zerar ao conseguir).
+ */
+void esperar( unsigned & tentativas ){
+    ++tentativas;
+    if ( tentativas < 64 )
+        return;
+    if ( tentativas < 1024 )
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for( std::chrono::microseconds( 50 ) );
 }
 
 
@@ -252,107 +210,772 @@ long int char2integer( std::string ch ){
 ////////////////////////////////////////////////////////////////////////////
 
 /** @brief Inicializa lendo o arquivo de entrada fornecido pelo cliente.
+    O arquivo é mapeado na memória e cada expressão é uma view sobre
+    o mapeamento, sem cópias nem alocações por linha.
     @param arq Nome do arquivo de entrada.
     @return 1 se o arquivo foi lido corretamente; 0 otherwise. */
 int  BaresManager::initialize( char * arq ){
 
-    // cria input file stream (ifstream)
-    std::ifstream arquivo;
-    // abre arquivo passado por linha de comando
-    arquivo.open( arq, std::ios::in );
-    // verifica se houve algum erro ao abrir arquivo
-    if (!arquivo.is_open()){
+    Stats::Estagio estagio( Stats::INITIALIZE );
+
+    // mapeia o arquivo passado por linha de comando
+    if ( not arquivo.open( arq ) ){
         return 0;
     }
 
-    do {
-        std::string operacao;
-        getline(arquivo, operacao);
-        expressions.push_back( operacao );
-    } while( arquivo.good() );
+    // separa as linhas direto sobre o mapeamento
+    arquivo.lines( expressions );
+
+    // cada linha ganha um registro vazio, preenchido pelos estágios seguintes
+    prepararRegistros( expressions.size(), expressions.size() );
 
-    // fechando arquivo
-    arquivo.close();
+    return 1;
 }
 
 /** @brief Valida expressões e separa em tokens.
-    @return Vetor com os tokens de todas as expressões no formato infix. */
-std::vector< std::vector< Token > > BaresManager::validarExpress(){
+    Cada expressão é analisada uma única vez e o resultado fica
+    guardado no registro da linha correspondente. */
+void BaresManager::validarExpress(){
 
-    Parser my_parser; // Instancia um parser.
+    Stats::Estagio estagio( Stats::VALIDAR );
+    auto stats = Stats::coletor();
 
-    std::vector< std::vector< Token > > allTokens;
+    Parser my_parser; // Instancia um parser.
 
     // Tentar analisar cada expressão da lista.
-    for( const auto & expr : expressions ){
+    for( size_t i = 0; i < expressions.size(); ++i ){
+
+        auto & rec = records[i];
+
+        // Fazer o parsing desta expressão, direto no registro.
+        auto inicio = stats ? Stats::agora() : 0;
+        rec.result = my_parser.parse( expressions[i], rec.tokens );
+        if ( stats )
+            contarParse( *stats, inicio, rec, rec.tokens.size() );
+
+        if ( rec.result.type != Parser::ParserResult::PARSER_OK )
+            rec.status = Record::SYNTAX_ERROR;
+
+    }
 
-        // Fazer o parsing desta expressão.
-        auto result = my_parser.parse( expr );
+}
+
+/** @brief Converte para postfix todas as expressões válidas.
+    Cada expressão é convertida direto para o registro da linha,
+    sem cópias intermediárias. */
+void BaresManager::converterExpress(){
+
+    Stats::Estagio estagio( Stats::CONVERTER );
+
+    for( auto & rec : records ){
+
+        if ( rec.status == Record::SYNTAX_ERROR )
+            continue;
+
+        // Converte direto no buffer do registro.
+        infix_to_postfix( rec.tokens, rec.postfix );
+    }
+
+}
+
+/** @brief Avalia todas as expressões já convertidas para postfix.
+    Cada expressão é compilada para bytecode, otimizada e
+    executada na VM. */
+void BaresManager::avaliarExpress(){
+
+    Stats::Estagio estagio( Stats::AVALIAR );
+    auto stats = Stats::coletor();
+
+    for( auto & rec : records ){
+
+        if ( rec.status == Record::SYNTAX_ERROR )
+            continue;
+
+        auto inicio = stats ? Stats::agora() : 0;
+        compile( rec.postfix, rec.program );
+        rec.removed_nodes = otimizador.run( rec.program );
+        auto result = vm.run( rec.program );
+
+        // Erros de execução (ex.: divisão por zero) ficam no registro
+        // para serem escritos no arquivo de saída.
+        if ( result.type == EvalResult::EVAL_OK ){
+            rec.value = result.value;
+            rec.status = Record::EVALUATED;
+        }
+        else {
+            rec.runtime_error = result.type;
+            rec.status = Record::RUNTIME_ERROR;
+        }
+        if ( stats )
+            contarEval( *stats, inicio, rec );
+    }
+
+}
+
+/** @brief Mostra no console a mensagem de uma expressão com erro.
+    @param rec Registro da expressão
+    @param expr Texto da expressão */
+void BaresManager::apresentarErro( const Record & rec, std::string_view expr ){
+    if ( rec.status == Record::SYNTAX_ERROR )
+        print_msg( rec.result, expr );
+    else if ( rec.status == Record::RUNTIME_ERROR )
+        std::cout << ">>> " << runtime_msg( rec.runtime_error ) << "!\n"
+                  << "\"" << expr << "\"\n";
+}
+
+/** @brief Mostra no console o que aconteceu com cada expressão, de
+    acordo com o nível de verbosidade. Os estágios de processamento
+    não imprimem nada; todo o log fica concentrado aqui. */
+void BaresManager::apresentarConsole(){
+
+    Stats::Estagio estagio( Stats::APRESENTAR );
+
+    if ( verbosity == verbosity_t::SILENT )
+        return;
+
+    if ( verbosity == verbosity_t::ERRORS ){
+        for( size_t i = 0; i < records.size(); ++i )
+            apresentarErro( records[i], expressions[i] );
+        return;
+    }
+
+    // verbosity_t::TRACE: o log completo de cada estágio.
+    for( size_t i = 0; i < records.size(); ++i ){
+
+        const auto & rec = records[i];
+        const auto & expr = expressions[i];
 
         // Preparar cabeçalho da saida.
         std::cout << std::setfill('=') << std::setw(80) << "\n";
         std::cout << std::setfill(' ') << ">>> Parsing \"" << expr << "\"\n";
 
         // Se deu pau, imprimir a mensagem adequada.
-        if ( result.type != Parser::ParserResult::PARSER_OK )
-            print_msg( result, expr );
+        if ( rec.status == Record::SYNTAX_ERROR )
+            print_msg( rec.result, expr );
         else
             std::cout << ">>> Expression SUCCESSFULLY parsed!\n";
 
-        auto lista = my_parser.get_tokens();
+        std::cout << ">>> Tokens: { ";
+        std::copy( rec.tokens.begin(), rec.tokens.end(),
+            std::ostream_iterator< Token >(std::cout, " ") );
+        std::cout << "}\n";
 
-        if ( result.type == Parser::ParserResult::PARSER_OK ) {
-            allTokens.push_back( lista );
-        }
+    }
+
+    // Imprimir para usários os tokens válidos e já no formato posfixo
+    std::cout << "\nTokens válidos e no formato postfix:\n";
+    for( const auto & rec : records ){
+
+        if ( rec.status == Record::SYNTAX_ERROR )
+            continue;
 
         std::cout << ">>> Tokens: { ";
-        std::copy( lista.begin(), lista.end(),
-            std::ostream_iterator< Token >(std::cout, " ") );
+        std::copy( rec.postfix.begin(), rec.postfix.end(),
+            std::ostream_iterator< Token >( std::cout, " ") );
         std::cout << "}\n";
+    }
+    std::cout << "\n";
 
+    // Refaz a avaliação pelo caminho instrumentado da VM, que mostra
+    // cada operação; o caminho rápido (VM::run) não tem nenhum log.
+    // O log usa o programa antes da otimização, com todas as operações.
+    Program completo;
+    for( const auto & rec : records ){
+
+        if ( rec.status == Record::SYNTAX_ERROR )
+            continue;
+
+        std::cout << ">>> Optimizer removed " << rec.removed_nodes << " of "
+                  << rec.postfix.size() << " nodes\n";
+
+        compile( rec.postfix, completo );
+        auto result = vm.trace( completo, std::cout );
+        if ( result.type == EvalResult::EVAL_OK )
+            std::cout << ">>> The result is: "  << result.value << "\n\n";
+        else
+            std::cout << ">>> " << runtime_msg( result.type ) << "!\n\n";
+    }
+
+}
+
+/** @brief Processa um intervalo de linhas [first, last).
+    Cada chamada usa seu próprio Parser e sua própria VM, então
+    intervalos disjuntos podem rodar em threads diferentes.
+    @param first Primeira linha do intervalo.
+    @param last Uma posição após a última linha do intervalo.
+    @param my_parser Parser da thread (a capacidade é mantida entre as chamadas).
+    @param cache Cache de resultados da thread (nullptr: sem cache). */
+void BaresManager::processarIntervalo( size_t first, size_t last, Parser & my_parser, ResultCache * cache ){
+
+    Stats::Coleta coleta; // contadores desta thread
+
+    Optimizer my_opt; // Idem para o otimizador
+    VM my_vm;         // e para a pilha da VM.
+
+    // Sem o log completo, os tokens infix não são mostrados: o parser
+    // já entrega o postfix, numa única passada.
+    const bool trace = verbosity == verbosity_t::TRACE;
+    my_parser.emit_postfix( not trace );
+
+    for( size_t i = first; i < last; ++i ){
+
+        auto & rec = records[i];
+
+        // Expressão repetida: o registro sai pronto do cache.
+        if ( cache and consultarCache( *cache, expressions[i], rec ) )
+            continue;
+
+        processarLinha( expressions[i], rec, my_parser, my_opt, my_vm, trace );
+
+        if ( cache )
+            cache->store( expressions[i], rec );
+    }
+
+}
+
+/** @brief Processa uma linha: parsing, conversão, bytecode e avaliação.
+    @param expr_ Expressão.
+    @param rec Registro da linha (recebe o estado final).
+    @param my_parser Parser (já configurado com emit_postfix( not trace )).
+    @param my_opt Otimizador.
+    @param my_vm Máquina virtual.
+    @param trace true para guardar também os tokens infix. */
+void BaresManager::processarLinha( std::string_view expr_, Record & rec, Parser & my_parser,
+                                   Optimizer & my_opt, VM & my_vm, bool trace ){
+
+    auto stats = Stats::coletor();
+    auto inicio = stats ? Stats::agora() : 0;
+
+    rec.result = my_parser.parse( expr_, trace ? rec.tokens : rec.postfix );
+    if ( stats )
+        contarParse( *stats, inicio, rec, trace ? rec.tokens.size() : rec.postfix.size() );
+
+    if ( rec.result.type != Parser::ParserResult::PARSER_OK ){
+        rec.status = Record::SYNTAX_ERROR;
+        return;
+    }
+
+    inicio = stats ? Stats::agora() : 0;
+    if ( trace )
+        infix_to_postfix( rec.tokens, rec.postfix );
+    compile( rec.postfix, rec.program );
+    rec.removed_nodes = my_opt.run( rec.program );
+
+    auto result = my_vm.run( rec.program );
+    if ( result.type == EvalResult::EVAL_OK ){
+        rec.value = result.value;
+        rec.status = Record::EVALUATED;
+    }
+    else {
+        rec.runtime_error = result.type;
+        rec.status = Record::RUNTIME_ERROR;
+    }
+    if ( stats )
+        contarEval( *stats, inicio, rec );
+
+}
+
+/** @brief Avalia uma única expressão e grava a linha de resultado.
+    @param expr_ Expressão.
+    @param saida_ Fluxo que recebe o resultado, com o '\n'. */
+void BaresManager::responder( std::string_view expr_, std::ostream & saida_ ){
+
+    // Parser, otimizador, VM e registro são os mesmos a cada chamada,
+    // então os buffers de todos eles já estão no tamanho certo.
+    if ( parsers.empty() )
+        parsers.emplace_back( new Parser() );
+    parsers[0]->emit_postfix( true );
+
+    processarLinha( expr_, avulso, *parsers[0], otimizador, vm, false );
+    escreverRegistro( saida_, avulso );
+    saida_ << "\n";
+
+}
+
+/** @brief Processa todas as expressões (parsing, conversão e avaliação)
+    dividindo as linhas entre várias threads, sem saída no console.
+    @param jobs Número de threads. */
+void BaresManager::processarParalelo( unsigned jobs ){
+
+    Stats::Estagio estagio( Stats::PARALELO );
+
+    if ( jobs == 0 )
+        jobs = 1;
+
+    // O tamanho (em bytes) de qualquer intervalo de linhas sai em O(1).
+    const size_t total = expressions.size();
+    acumulado.resize( total + 1 );
+    acumulado[0] = 0;
+    for( size_t i = 0; i < total; ++i )
+        acumulado[ i + 1 ] = acumulado[i] + expressions[i].size() + 1;
+
+    // Não há trabalho para mais threads que linhas (ou, com linhas
+    // longas, que grupos de termos de TAMANHO_GRUPO bytes).
+    const size_t unidades = std::max< size_t >( total, acumulado[ total ] / TAMANHO_GRUPO );
+    jobs = static_cast< unsigned >( std::min< size_t >( jobs, std::max< size_t >( unidades, 1 ) ) );
+
+    // A thread k começa com o k-ésimo bloco contíguo de linhas; o resto
+    // do equilíbrio fica com o roubo de trabalho. Cada linha é escrita
+    // só no seu registro, então a ordem original é mantida pelos índices.
+    const size_t bloco = std::max< size_t >( ( total + jobs - 1 ) / jobs, 1 );
+
+    // Cada thread aloca na sua arena (o registro muda de arena se a
+    // linha for roubada).
+    prepararRegistros( total, bloco );
+    while ( arenas.size() < jobs )
+        arenas.emplace_back( new Arena() );
+
+    // O cache, o Parser e o resto do estado da thread k sobrevivem entre
+    // as chamadas (blocos do modo stream).
+    const bool usar_cache = capacidade_cache > 0 and verbosity != verbosity_t::TRACE;
+    if ( usar_cache )
+        while ( caches.size() < jobs )
+            caches.emplace_back( capacidade_cache );
+    while ( parsers.size() < jobs )
+        parsers.emplace_back( new Parser() );
+
+    // Uma thread só: o próprio chamador processa tudo, em ordem.
+    if ( jobs == 1 ){
+        processarIntervalo( 0, total, *parsers[0], usar_cache ? &caches[0] : nullptr );
+        return;
+    }
+
+    while ( trabalhadores.size() < jobs )
+        trabalhadores.emplace_back( new Trabalhador() );
+
+    Escala e;
+    e.jobs = jobs;
+    e.trace = verbosity == verbosity_t::TRACE;
+    e.usar_cache = usar_cache;
+    e.restantes.store( total, std::memory_order_relaxed );
+
+    for( unsigned k = 0; k < jobs; ++k ){
+        size_t first = std::min( k * bloco, total );
+        size_t last = std::min( first + bloco, total );
+        if ( first < last )
+            trabalhadores[k]->tarefas.push( Tarefa{ first, last, nullptr } );
+    }
+
+    std::vector< std::thread > workers;
+    for( unsigned k = 1; k < jobs; ++k )
+        workers.emplace_back( &BaresManager::trabalhar, this, k, std::ref( e ) );
+    trabalhar( 0, e );
+
+    for( auto & w : workers )
+        w.join();
+
+}
+
+/** @brief Laço de um worker: executa as tarefas da sua deque e, sem
+    tarefas, rouba das outras, até todas as linhas terminarem.
+    @param k Índice do worker.
+    @param e Estado da chamada. */
+void BaresManager::trabalhar( unsigned k, Escala & e ){
+
+    Stats::Coleta coleta; // contadores desta thread
+
+    parsers[k]->emit_postfix( not e.trace );
+    auto & minhas = trabalhadores[k]->tarefas;
+
+    unsigned tentativas = 0;
+    while ( e.restantes.load( std::memory_order_acquire ) > 0 ){
+
+        // As próprias tarefas saem pelo fim (as mais recentes); as dos
+        // outros, pelo início (as mais antigas, que são as maiores).
+        Tarefa t;
+        bool achou = minhas.pop( t );
+        for( unsigned v = 1; not achou and v < e.jobs; ++v )
+            achou = trabalhadores[ ( k + v ) % e.jobs ]->tarefas.steal( t );
+        if ( not achou ){
+            esperar( tentativas );
+            continue;
+        }
+        tentativas = 0;
+
+        if ( t.divisao ){
+            avaliarGrupos( k, *t.divisao, t.inicio, t.fim, e );
+            continue;
+        }
+
+        // Divide o intervalo ao meio até ele caber num pedaço; as metades
+        // da direita ficam na deque, onde outro worker pode roubá-las.
+        while ( t.fim - t.inicio > 1 and acumulado[ t.fim ] - acumulado[ t.inicio ] > TAMANHO_PEDACO ){
+            size_t meio = t.inicio + ( t.fim - t.inicio ) / 2;
+            minhas.push( Tarefa{ meio, t.fim, nullptr } );
+            t.fim = meio;
+        }
+        processarPedaco( k, t.inicio, t.fim, e );
+    }
+
+}
+
+/** @brief Processa um pedaço de linhas [first, last) no worker k.
+    @param k Índice do worker.
+    @param first Primeira linha do pedaço.
+    @param last Uma posição após a última linha do pedaço.
+    @param e Estado da chamada. */
+void BaresManager::processarPedaco( unsigned k, size_t first, size_t last, Escala & e ){
+
+    auto & w = *trabalhadores[k];
+    ResultCache * cache = e.usar_cache ? &caches[k] : nullptr;
+
+    size_t feitas = 0;
+    for( size_t i = first; i < last; ++i ){
+
+        auto & rec = records[i];
+        rec.reset( arenas[k].get() );
+
+        // Linha longa: os termos viram tarefas e a linha termina quando
+        // o último deles for avaliado (talvez em outra thread).
+        if ( not e.trace and expressions[i].size() >= LIMITE_DIVISAO and dividirLinha( k, i, e ) )
+            continue;
+
+        ++feitas;
+        if ( cache and consultarCache( *cache, expressions[i], rec ) )
+            continue;
+
+        processarLinha( expressions[i], rec, *parsers[k], w.otimizador, w.vm, e.trace );
+
+        if ( cache )
+            cache->store( expressions[i], rec );
+    }
+
+    e.restantes.fetch_sub( feitas, std::memory_order_acq_rel );
+
+}
+
+/**
+ * @brief Separa uma expressão nos termos ligados por '+' e '-' fora de
+ * parênteses. Um '-' só é binário depois de um termo (dígito, letra ou
+ * ')'); os outros são o sinal de um número.
+ * @param expr Expressão.
+ * @param termos Recebe os termos, sem os operadores.
+ * @param operadores Recebe o operador antes de cada termo ('+' no primeiro).
+ * @return false se os parênteses não fecham (a expressão não é dividida).
+ */
+bool dividirTermos( std::string_view expr, std::vector< std::string_view > & termos, std::vector< char > & operadores ){
+
+    termos.clear();
+    operadores.clear();
+
+    int profundidade = 0;
+    bool depois_de_termo = false;
+    size_t inicio = 0;
+    char operador = '+';
+
+    for( size_t i = 0; i < expr.size(); ++i ){
+        switch ( expr[i] ){
+            case ' ':
+            case '\t':
+                break;
+            case '(':
+                ++profundidade;
+                depois_de_termo = false;
+                break;
+            case ')':
+                if ( --profundidade < 0 )
+                    return false;
+                depois_de_termo = true;
+                break;
+            case '+':
+            case '-':
+                if ( profundidade == 0 and depois_de_termo ){
+                    termos.push_back( expr.substr( inicio, i - inicio ) );
+                    operadores.push_back( operador );
+                    operador = expr[i];
+                    inicio = i + 1;
+                }
+                depois_de_termo = false;
+                break;
+            case '*':
+            case '/':
+            case '%':
+            case '^':
+                depois_de_termo = false;
+                break;
+            default:
+                depois_de_termo = true;
+        }
+    }
+
+    termos.push_back( expr.substr( inicio ) );
+    operadores.push_back( operador );
+    return profundidade == 0;
+}
+
+/** @brief Divide uma linha longa nos termos de fora e distribui os
+    grupos de termos como tarefas (o primeiro grupo é avaliado aqui).
+    @param k Índice do worker.
+    @param linha Índice da linha.
+    @param e Estado da chamada.
+    @return false se a linha não pode ser dividida. */
+bool BaresManager::dividirLinha( unsigned k, size_t linha, Escala & e ){
+
+    std::unique_ptr< Divisao > nova( new Divisao() );
+    auto & d = *nova;
+    d.linha = linha;
+    if ( not dividirTermos( expressions[linha], d.termos, d.operadores ) )
+        return false;
+
+    // Termos seguidos formam grupos de uns TAMANHO_GRUPO bytes: um termo
+    // por tarefa seria pequeno demais para compensar o roubo.
+    size_t bytes = 0;
+    d.grupos.push_back( 0 );
+    for( size_t t = 0; t < d.termos.size(); ++t ){
+        bytes += d.termos[t].size() + 1;
+        if ( bytes >= TAMANHO_GRUPO and t + 1 < d.termos.size() ){
+            d.grupos.push_back( t + 1 );
+            bytes = 0;
+        }
+    }
+    d.grupos.push_back( d.termos.size() );
+
+    const size_t n_grupos = d.grupos.size() - 1;
+    if ( n_grupos < 2 )
+        return false;
+
+    d.resultados.resize( d.termos.size() );
+    d.faltam.store( n_grupos, std::memory_order_relaxed );
+    {
+        std::lock_guard< std::mutex > lk( e.trava );
+        e.divisoes.push_back( std::move( nova ) );
     }
 
-    return allTokens;
+    // Os grupos do fim vão para o início da deque, onde são roubados
+    // primeiro; o worker segue pelos do começo.
+    auto & minhas = trabalhadores[k]->tarefas;
+    for( size_t g = n_grupos - 1; g > 0; --g )
+        minhas.push( Tarefa{ g, g + 1, &d } );
+    avaliarGrupos( k, d, 0, 1, e );
+
+    return true;
+}
+
+/** @brief Avalia os grupos [first, last) de uma linha dividida; o último
+    worker a terminar monta o resultado da linha.
+    @param k Índice do worker.
+    @param d Linha dividida.
+    @param first Primeiro grupo.
+    @param last Uma posição após o último grupo.
+    @param e Estado da chamada. */
+void BaresManager::avaliarGrupos( unsigned k, Divisao & d, size_t first, size_t last, Escala & e ){
+
+    auto & w = *trabalhadores[k];
+    auto & my_parser = *parsers[k];
+
+    auto stats = Stats::coletor();
+    Stats::ticks_t ticks_parse = 0, ticks_eval = 0;
+    size_t tokens = 0;
+
+    for( size_t t = d.grupos[ first ]; t < d.grupos[ last ]; ++t ){
+
+        // Um termo inválido faz a linha inteira ser refeita: os outros
+        // termos não precisam mais ser avaliados.
+        if ( d.invalida.load( std::memory_order_relaxed ) )
+            break;
+
+        auto inicio = stats ? Stats::agora() : 0;
+        if ( my_parser.parse( d.termos[t], w.termo ).type != Parser::ParserResult::PARSER_OK ){
+            d.invalida.store( true, std::memory_order_relaxed );
+            break;
+        }
+        if ( stats ){
+            auto agora = Stats::agora();
+            ticks_parse += agora - inicio;
+            tokens += w.termo.size();
+            inicio = agora;
+        }
+
+        compile( w.termo, w.programa );
+        w.otimizador.run( w.programa );
+        d.resultados[t] = w.vm.run( w.programa );
+        if ( stats )
+            ticks_eval += Stats::agora() - inicio;
+    }
+
+    // A linha conta uma vez só, em combinarTermos(), com o tempo somado
+    // de todos os termos.
+    if ( stats ){
+        d.ticks_parse.fetch_add( ticks_parse, std::memory_order_relaxed );
+        d.ticks_eval.fetch_add( ticks_eval, std::memory_order_relaxed );
+        d.tokens.fetch_add( tokens, std::memory_order_relaxed );
+    }
+
+    if ( d.faltam.fetch_sub( last - first, std::memory_order_acq_rel ) == last - first ){
+        combinarTermos( k, d );
+        e.restantes.fetch_sub( 1, std::memory_order_acq_rel );
+    }
+
+}
+
+/** @brief Monta o resultado de uma linha dividida a partir dos termos.
+    @param k Índice do worker.
+    @param d Linha dividida, com todos os termos avaliados. */
+void BaresManager::combinarTermos( unsigned k, Divisao & d ){
+
+    auto & rec = records[ d.linha ];
+    rec.reset( arenas[k].get() );
+
+    // Erro de sintaxe: a linha inteira passa pelo parser, para que o
+    // código e a coluna do erro sejam os mesmos da execução serial.
+    if ( d.invalida.load( std::memory_order_relaxed ) ){
+        auto & w = *trabalhadores[k];
+        processarLinha( expressions[ d.linha ], rec, *parsers[k], w.otimizador, w.vm, false );
+        return;
+    }
+
+    // A VM avalia "t0 + t1 - t2 ..." da esquerda para a direita: o erro
+    // que vale é o primeiro nessa mesma ordem (um termo ou uma conta).
+    rec.result = Parser::ParserResult();
+    Token::value_type acc = 0;
+    EvalResult::code_t erro = EvalResult::EVAL_OK;
+    for( size_t t = 0; t < d.termos.size() and erro == EvalResult::EVAL_OK; ++t ){
+        erro = d.resultados[t].type;
+        if ( erro != EvalResult::EVAL_OK )
+            break;
+        if ( t == 0 )
+            acc = d.resultados[t].value;
+        else if ( d.operadores[t] == '+' )
+            erro = op_add( acc, d.resultados[t].value, acc );
+        else
+            erro = op_sub( acc, d.resultados[t].value, acc );
+    }
+
+    if ( erro == EvalResult::EVAL_OK ){
+        rec.value = acc;
+        rec.status = Record::EVALUATED;
+    }
+    else {
+        rec.runtime_error = erro;
+        rec.status = Record::RUNTIME_ERROR;
+    }
+
+    // Os operadores entre os termos também são tokens da linha.
+    if ( auto stats = Stats::coletor() ){
+        stats->parse.add( d.ticks_parse.load( std::memory_order_relaxed ) );
+        ++stats->expressoes;
+        stats->tokens += d.tokens.load( std::memory_order_relaxed ) + d.termos.size() - 1;
+        ++stats->erros_sintaxe[ Parser::ParserResult::PARSER_OK ];
+        stats->eval.add( d.ticks_eval.load( std::memory_order_relaxed ) );
+        if ( rec.status == Record::RUNTIME_ERROR )
+            ++stats->erros_execucao[ rec.runtime_error ];
+    }
+
+}
+
+/** @brief Liga o cache de resultados de processarParalelo() e
+    processarStream().
+    @param capacidade_ Expressões por cache (0 desliga o cache). */
+void BaresManager::set_cache( size_t capacidade_ ){
+    capacidade_cache = capacidade_;
+    caches.clear();
+}
+
+/// Número de consultas ao cache com acerto (soma de todas as threads).
+size_t BaresManager::cache_hits( void ) const {
+    size_t n = 0;
+    for( const auto & c : caches )
+        n += c.hits();
+    return n;
+}
+
+/// Número de consultas ao cache sem acerto (soma de todas as threads).
+size_t BaresManager::cache_misses( void ) const {
+    size_t n = 0;
+    for( const auto & c : caches )
+        n += c.misses();
+    return n;
+}
+
+/** @brief Prepara os registros de um novo lote de linhas.
+    @param n Número de linhas do lote.
+    @param bloco Linhas por bloco (por thread). */
+void BaresManager::prepararRegistros( size_t n, size_t bloco ){
+
+    // Os registros antigos apontam para as arenas: saem antes do reset.
+    records.clear();
+
+    const size_t n_blocos = bloco ? std::max< size_t >( ( n + bloco - 1 ) / bloco, 1 ) : 1;
+    while ( arenas.size() < n_blocos )
+        arenas.emplace_back( new Arena() );
+    for( auto & a : arenas )
+        a->reset();
+
+    // A capacidade do vetor de registros é aproveitada entre os lotes.
+    records.reserve( n );
+    for( size_t i = 0; i < n; ++i )
+        records.emplace_back( arenas[ bloco ? i / bloco : 0 ].get() );
 
 }
 
 /** @brief Transforma expressão do formado infix para postfix.
-    @param inflix_ Tokens da expressão no formato infix
-    @return Vetor com os tokens de todas as expressões no formato postfix. */
-std::vector< std::vector< Token > > BaresManager::infix_to_postfix( std::vector< Token > infix_ ){
+    @param infix_ Tokens da expressão no formato infix
+    @return Tokens da expressão no formato postfix. */
+TokenList BaresManager::infix_to_postfix( const TokenList & infix_ ){
+
+    TokenList temp;
+    infix_to_postfix( infix_, temp );
 
-    // Stack para ajudar a converter a expressao.
-    std::stack< char > s;
+    return temp;
 
-    std::vector< Token > temp;
+}
+
+/** @brief Transforma expressão do formado infix para postfix.
+    @param infix_ Tokens da expressão no formato infix
+    @param postfix_ Buffer que recebe os tokens no formato postfix
+           (é esvaziado antes, mas a capacidade é aproveitada). A
+           pilha de operadores usa um buffer local e, se crescer
+           além dele, o mesmo memory_resource de postfix_. */
+void BaresManager::infix_to_postfix( const TokenList & infix_, TokenList & postfix_ ){
+
+    // Stack para ajudar a converter a expressao. Cabe no buffer local
+    // (na pilha de chamadas) enquanto tiver até ~120 operadores pendentes.
+    std::byte local[ 2048 ];
+    std::pmr::monotonic_buffer_resource mem( local, sizeof local, postfix_.get_allocator().resource() );
+    std::pmr::vector< Token > s( &mem );
+
+    // A saída nunca tem mais tokens do que a entrada.
+    postfix_.clear();
+    postfix_.reserve( infix_.size() );
 
     // Percorre expressao infixa
-    for( auto & tk : infix_ ){
+    for( const auto & tk : infix_ ){
         // Operando vai direto para fila de saída
         if ( is_operand( tk ) ) // 1 23 100, etc.
         {
-            temp.push_back( Token( tk.value, Token::token_t::OPERAND ) );
+            postfix_.push_back( tk );
         }
         else if ( is_operator( tk ) ) // + - ^ % etc.
         {
 
-            // conversao std::string para char
-            char op = (tk.value)[0];
-
             // Tirar todos os elementos com prioridade alta
             while( not s.empty() and
-                   has_higher_precedence( s.top() , op ) )
+                   has_higher_precedence( s.back().op , tk.op ) )
             {
-                std::string top;
-                top.push_back( s.top() );
-                temp.push_back( Token( top, Token::token_t::OPERATOR ) );
-                s.pop();
+                postfix_.push_back( s.back() );
+                s.pop_back();
             }
 
             // The incoming operator always goes into the stack.
-            s.push( op );
+            s.push_back( tk );
 
         }
+        else if ( tk.type == Token::token_t::OPENING_SCOPE ) // "("
+        {
+            // '(' tem a menor prioridade: segura os operadores de fora.
+            s.push_back( tk );
+        }
+        else if ( tk.type == Token::token_t::CLOSING_SCOPE ) // ")"
+        {
+            // Tirar todos os operadores do escopo até o '(' correspondente.
+            while( not s.empty() and s.back().type != Token::token_t::OPENING_SCOPE )
+            {
+                postfix_.push_back( s.back() );
+                s.pop_back();
+            }
+            if ( not s.empty() )
+                s.pop_back(); // descarta o '('
+        }
         else // anything else.
         {
             // ignore this char.
@@ -362,98 +985,505 @@ std::vector< std::vector< Token > > BaresManager::infix_to_postfix( std::vector<
     // Tirar todos os operadores restantes na pilha
     while( not s.empty() )
     {
-        std::string top;
-        top.push_back( s.top() );
-        temp.push_back( Token( top, Token::token_t::OPERATOR ) );
-
-        s.pop();
+        postfix_.push_back( s.back() );
+        s.pop_back();
     }
 
-    postfix.push_back( temp );
-
-    return postfix;
-
 }
 
 /** @brief Realiza a operação.
     @param postfix Vetor com tokens da expressão no formato postfix
-    @return Resultado da expressão. */
-int BaresManager::evaluate_postfix( std::vector< Token > postfix ) {
+    @param valores Valor de cada variável, pelo índice (apenas se
+           a expressão tem variáveis)
+    @return Resultado da expressão (valor ou erro de execução). */
+EvalResult BaresManager::evaluate_postfix( const TokenList & postfix, const Token::value_type * valores ) {
 
-    std::stack< long int > s;
+    Program prog;
+    compile( postfix, prog );
+    otimizador.run( prog );
 
-    // Percorre expressao posfixa
-    for( auto tk : postfix ){
+    return vm.run( prog, valores );
 
-        if ( is_operand( tk ) ) { // verifica se o token é um operando
-            s.push( char2integer( tk.value ) );
-        }
+}
 
-        else if ( is_operator( tk ) ) {
-            // Recupera os dois operandos na ordem inversa
-            auto op2 = s.top(); s.pop();
-            auto op1 = s.top(); s.pop();
+/** @brief Compila uma expressão com variáveis uma única vez.
+    @param expr_ Expressão, ex.: "preco * qtd - desconto".
+    @param formula_ Recebe o programa e os nomes das variáveis.
+    @return Resultado do parser (PARSER_OK se a fórmula é válida). */
+Parser::ParserResult BaresManager::compilarFormula( std::string_view expr_, Formula & formula_ ){
 
-            char ch = (tk.value)[0];
-            std::cout << ">>> Performing " << op1 << " " << ch << " " << op2 << "\n";
-            int result = execute_operator( op1, op2, ch );
-            s.push(result);
-        }
+    Parser my_parser;
+    my_parser.allow_variables( true );
+    my_parser.emit_postfix( true );
 
-        else {
-            assert(false);
-        }
+    auto result = my_parser.parse( expr_ );
+    if ( result.type != Parser::ParserResult::PARSER_OK )
+        return result;
+
+    compile( my_parser.get_tokens(), formula_.program );
+    otimizador.run( formula_.program );
+    formula_.variables = my_parser.get_variables();
+
+    return result;
+
+}
+
+/** @brief Avalia uma fórmula compilada.
+    @param formula_ Fórmula compilada por compilarFormula().
+    @param valores_ Valor de cada variável, na ordem de formula_.variables.
+    @return Resultado da expressão (valor ou erro de execução). */
+EvalResult BaresManager::avaliarFormula( const Formula & formula_, const Token::value_type * valores_ ){
+    return vm.run( formula_.program, valores_ );
+}
 
+/** @brief Avalia uma fórmula compilada para um lote de linhas, coluna a coluna.
+    @param formula_ Fórmula compilada por compilarFormula().
+    @param colunas_ Para cada variável, o valor dela em cada linha.
+    @param n_ Número de linhas.
+    @param valores_ Recebe o valor de cada linha.
+    @param erros_ Recebe o código do erro de cada linha (EVAL_OK se não houve erro). */
+void BaresManager::avaliarFormulaLote( const Formula & formula_, const Token::value_type * const * colunas_,
+                                       size_t n_, Token::value_type * valores_, std::uint8_t * erros_ ){
+    lote.run( formula_.program, colunas_, n_, valores_, erros_ );
+}
+
+/**
+ * @brief Divide uma linha de CSV nos seus campos, sem espaços nas pontas.
+ * @param linha Linha do CSV.
+ * @param campos Recebe uma view por campo (a capacidade é aproveitada).
+ */
+void split_csv( std::string_view linha, std::vector< std::string_view > & campos ){
+
+    campos.clear();
+
+    size_t inicio = 0;
+    while ( true ){
+        size_t fim = linha.find( ',', inicio );
+        auto campo = linha.substr( inicio, fim == std::string_view::npos ? std::string_view::npos : fim - inicio );
+
+        // Ignora espaços, tabs e um '\r' de fim de linha.
+        while ( not campo.empty() and ( campo.front() == ' ' or campo.front() == '\t' ) )
+            campo.remove_prefix( 1 );
+        while ( not campo.empty() and ( campo.back() == ' ' or campo.back() == '\t' or campo.back() == '\r' ) )
+            campo.remove_suffix( 1 );
+        campos.push_back( campo );
+
+        if ( fim == std::string_view::npos )
+            break;
+        inicio = fim + 1;
     }
 
-    int result = s.top();
+}
 
-    std::cout << ">>> The result is: "  << result << std::endl;
-    std::cout << "\n";
+/** @brief Avalia uma expressão com variáveis para cada linha de um
+    CSV e grava um resultado por linha em resultados.txt.
+    @param expr_ Expressão com variáveis.
+    @param csv_ Fluxo com o CSV.
+    @return 1 se os resultados foram gravados; 0 otherwise. */
+int BaresManager::processarBindings( std::string_view expr_, std::istream & csv_ ){
+
+    Stats::Estagio estagio( Stats::BINDINGS );
+
+    // A expressão é compilada uma única vez para todas as linhas.
+    Formula formula;
+    auto result = compilarFormula( expr_, formula );
+    if ( result.type != Parser::ParserResult::PARSER_OK ){
+        std::cerr << ">>> ";
+        message( std::cerr, result );
+        std::cerr << "\n\"" << expr_ << "\"\n";
+        return 0;
+    }
 
-    return result;
+    // Cabeçalho: descobre a coluna de cada variável.
+    std::string linha;
+    std::vector< std::string_view > campos;
+    getline( csv_, linha );
+    split_csv( linha, campos );
+
+    std::vector< size_t > coluna( formula.variables.size() );
+    for( size_t v = 0; v < formula.variables.size(); ++v ){
+        auto it = std::find( campos.begin(), campos.end(), formula.variables[v] );
+        if ( it == campos.end() ){
+            std::cerr << ">>> Variable \"" << formula.variables[v] << "\" not found in the CSV header!\n";
+            return 0;
+        }
+        coluna[v] = it - campos.begin();
+    }
+
+    std::ofstream arqsaida;
+    buffer_saida.resize( TAMANHO_BUFFER_SAIDA );
+    arqsaida.rdbuf()->pubsetbuf( buffer_saida.data(), buffer_saida.size() );
+    arqsaida.open( "resultados.txt", std::ios::out );
+    if ( !arqsaida.is_open() )
+        return 0;
+
+    // As linhas são lidas em lotes e avaliadas pela VM colunar: cada
+    // variável vira uma coluna com um valor por linha do lote.
+    const size_t LOTE = 16 * BatchVM::BLOCO;
+    const size_t n_vars = formula.variables.size();
+    std::vector< std::vector< Token::value_type > > colunas( n_vars, std::vector< Token::value_type >( LOTE ) );
+    std::vector< const Token::value_type * > ptrs( n_vars );
+    for( size_t v = 0; v < n_vars; ++v )
+        ptrs[v] = colunas[v].data();
+    std::vector< Token::value_type > valores( LOTE );
+    std::vector< std::uint8_t > erros( LOTE );
+    std::vector< int > invalida( LOTE ); // Variável com valor inválido (-1: nenhuma).
+
+    bool fim = false;
+    while ( not fim ){
+
+        size_t n = 0;
+        while ( n < LOTE ){
+            if ( not getline( csv_, linha ) ){
+                fim = true;
+                break;
+            }
+
+            // Linhas em branco não são dados.
+            if ( linha.empty() or linha == "\r" )
+                continue;
+
+            split_csv( linha, campos );
+
+            invalida[n] = -1;
+            for( size_t v = 0; v < n_vars; ++v ){
+                const auto c = coluna[v];
+                bool ok = c < campos.size();
+                if ( ok ){
+                    auto fim_campo = campos[c].data() + campos[c].size();
+                    auto r = std::from_chars( campos[c].data(), fim_campo, colunas[v][n] );
+                    ok = r.ec == std::errc() and r.ptr == fim_campo;
+                }
+                if ( not ok ){
+                    // A linha é avaliada com zeros, mas o resultado é descartado.
+                    for( size_t w = 0; w < n_vars; ++w )
+                        colunas[w][n] = 0;
+                    invalida[n] = v;
+                    break;
+                }
+            }
+            ++n;
+        }
+
+        avaliarFormulaLote( formula, ptrs.data(), n, valores.data(), erros.data() );
+
+        for( size_t i = 0; i < n; ++i ){
+            if ( invalida[i] >= 0 )
+                arqsaida << "Invalid value for \"" << formula.variables[ invalida[i] ] << "\"!\n";
+            else if ( erros[i] == EvalResult::EVAL_OK )
+                arqsaida << valores[i] << "\n";
+            else
+                arqsaida << runtime_msg( (EvalResult::code_t) erros[i] ) << "!\n";
+        }
+    }
+
+    return 1;
 
 }
 
 /** @brief Apresenta resultado final das expressões.
-    @param res Vetor com resultados das expressões válidas */
-void BaresManager::apresentarResult( std::vector< int > res ){
-
-    Parser my_parser; // Instancia um parser.
+    Apenas escreve os registros já processados, sem refazer o parsing. */
+void BaresManager::apresentarResult(){
 
-    std::vector< std::vector< Token > > allTokens;
+    Stats::Estagio estagio( Stats::APRESENTAR );
 
     // Configurando saída dos dados em arquivo
     std::ofstream arqsaida;
+    // Buffer grande: a escrita vai para o disco em poucas chamadas.
+    buffer_saida.resize( TAMANHO_BUFFER_SAIDA );
+    arqsaida.rdbuf()->pubsetbuf( buffer_saida.data(), buffer_saida.size() );
     // Cria e abre arquivo
     arqsaida.open( "resultados.txt" , std::ios::out );
     // Se houver erro, sai do programa
 	if ( !arqsaida.is_open() )
 		return;
 
+    escreverRegistros( arqsaida );
 
-    int cont = 0;
+    arqsaida.close();
 
-    // Tentar analisar cada expressão da lista.
-    for( const auto & expr : expressions ){
+}
 
-        // Fazer o parsing desta expressão.
-        auto result = my_parser.parse( expr );
+/** @brief Grava o resultado de cada registro, um por linha.
+    @param arqsaida Fluxo de saída dos resultados */
+void BaresManager::escreverRegistros( std::ostream & arqsaida ){
 
-        // Se deu pau, imprimir a mensagem adequada.
-        if ( result.type != Parser::ParserResult::PARSER_OK ){
-            message( cont, arqsaida, result );
+    for( size_t i = 0; i < records.size(); ++i ){
+        escreverRegistro( arqsaida, records[i] );
+        arqsaida << "\n";
+    }
+
+}
+
+/** @brief Grava o resultado de um registro (sem o '\n').
+    @param arqsaida Fluxo de saída dos resultados
+    @param rec Registro da expressão */
+void BaresManager::escreverRegistro( std::ostream & arqsaida, const Record & rec ){
+
+    switch ( rec.status )
+    {
+        case Record::SYNTAX_ERROR:
+            message( arqsaida, rec.result );
+            break;
+        case Record::RUNTIME_ERROR:
+            arqsaida << runtime_msg( rec.runtime_error ) << "!";
+            break;
+        case Record::EVALUATED:
+            arqsaida << rec.value;
+            break;
+        default:
+            /* Empty */;
+    }
+
+}
+
+/** @brief Processa a entrada em blocos de tamanho fixo: lê, avalia e
+    grava cada bloco antes de ler o próximo, então a memória usada
+    não depende do tamanho da entrada.
+    @param entrada Fluxo de entrada (arquivo ou std::cin).
+    @param jobs Número de threads por bloco (0 ou 1: serial).
+    @param bloco Número de linhas por bloco.
+    @return 1 se os resultados foram gravados; 0 otherwise. */
+int BaresManager::processarStream( std::istream & entrada, unsigned jobs, size_t bloco ){
+
+    Stats::Estagio estagio( Stats::STREAM );
+
+    // Buffer grande: a escrita vai para o disco em poucas chamadas.
+    std::ofstream arqsaida;
+    buffer_saida.resize( TAMANHO_BUFFER_SAIDA );
+    arqsaida.rdbuf()->pubsetbuf( buffer_saida.data(), buffer_saida.size() );
+    arqsaida.open( "resultados.txt", std::ios::out );
+    if ( !arqsaida.is_open() )
+        return 0;
+
+    if ( bloco == 0 )
+        bloco = 1;
+
+    // As strings e os registros do bloco anterior são reaproveitados,
+    // mantendo a capacidade já alocada.
+    linhas.resize( bloco );
+
+    bool fim = false;
+    while ( not fim ){
+
+        // Ler até 'bloco' linhas (mesma regra de initialize(): a última
+        // leitura, mesmo vazia, também vira uma expressão).
+        size_t n = 0;
+        while ( n < bloco ){
+            getline( entrada, linhas[n] );
+            ++n;
+            if ( not entrada.good() ){
+                fim = true;
+                break;
+            }
         }
-        else{
-        	int tam = expressions[cont].size();
-            arqsaida << res[cont];
-            cont++;
+
+        expressions.assign( linhas.begin(), linhas.begin() + n );
+
+        processarParalelo( jobs );
+
+        apresentarConsole();
+        escreverRegistros( arqsaida );
+    }
+
+    return 1;
+
+}
+
+/** @brief Processa a entrada num pipeline de estágios simultâneos.
+    @param entrada Fluxo de entrada (arquivo ou std::cin).
+    @param jobs Número de threads de parsing e avaliação (0: 1).
+    @param bloco Número de linhas por lote.
+    @return 1 se os resultados foram gravados; 0 otherwise. */
+int BaresManager::processarPipeline( std::istream & entrada, unsigned jobs, size_t bloco ){
+
+    // O log completo mostra os tokens infix, que este modo não guarda.
+    if ( verbosity == verbosity_t::TRACE )
+        return processarStream( entrada, jobs, bloco );
+
+    Stats::Estagio estagio( Stats::PIPELINE );
+
+    std::ofstream arqsaida;
+    buffer_saida.resize( TAMANHO_BUFFER_SAIDA );
+    arqsaida.rdbuf()->pubsetbuf( buffer_saida.data(), buffer_saida.size() );
+    arqsaida.open( "resultados.txt", std::ios::out );
+    if ( !arqsaida.is_open() )
+        return 0;
+
+    if ( jobs == 0 )
+        jobs = 1;
+    if ( bloco == 0 )
+        bloco = 1;
+
+    // Lê um lote; true se a entrada acabou. Mesma regra de
+    // processarStream(): a última leitura, mesmo vazia, também vira
+    // uma expressão.
+    auto ler = [&]( Lote & l ){
+        if ( l.linhas.size() < bloco )
+            l.linhas.resize( bloco );
+        size_t n = 0;
+        while ( n < bloco ){
+            getline( entrada, l.linhas[n] );
+            ++n;
+            if ( not entrada.good() ){
+                l.n = n;
+                return true;
+            }
         }
+        l.n = n;
+        return false;
+    };
+
+    // O primeiro lote é lido antes de tudo: uma entrada que cabe nele
+    // não tem trabalho para mais de um worker.
+    std::vector< std::unique_ptr< Lote > > lotes;
+    lotes.emplace_back( new Lote() );
+    const bool lote_unico = ler( *lotes[0] );
+    lotes[0]->seq = 0;
+    if ( lote_unico )
+        jobs = 1;
+
+    // Lotes em circulação: cada worker com um, um sendo lido e os que
+    // esperam na fila ou no escritor. Fixo: é o que limita a memória.
+    const size_t n_lotes = 2 * jobs + 2;
+    SpscQueue< Lote * > livres( n_lotes );               // escritor -> leitor
+    MpmcQueue< Lote * > trabalho( n_lotes + jobs );      // leitor -> workers (+ um fim por worker)
+    MpmcQueue< Lote * > prontos( n_lotes );              // workers -> escritor
+    trabalho.try_push( lotes[0].get() );
+    for( size_t i = 1; i < n_lotes; ++i ){
+        lotes.emplace_back( new Lote() );
+        livres.try_push( lotes.back().get() );
+    }
 
-        arqsaida << "\n";
+    // Worker k usa o parser e o cache k, que sobrevivem entre as chamadas.
+    const bool usar_cache = capacidade_cache > 0;
+    if ( usar_cache )
+        while ( caches.size() < jobs )
+            caches.emplace_back( capacidade_cache );
+    while ( parsers.size() < jobs )
+        parsers.emplace_back( new Parser() );
+
+    pipeline = PipelineStats();
+    std::atomic< size_t > total_lotes{ std::numeric_limits< size_t >::max() };
+    std::atomic< size_t > esperas_workers{ 0 };
+
+    //=== Leitor: enche lotes livres e os passa aos workers.
+    std::thread leitor( [&]{
+        Stats::Coleta coleta;
+        size_t seq = 1; // o lote 0 já foi lido
+        size_t esperas = 0;
+        unsigned tentativas = 0;
+        bool fim = lote_unico;
+        while ( not fim ){
+            Lote * atual;
+            while ( not livres.try_pop( atual ) ){
+                ++esperas;
+                esperar( tentativas );
+            }
+            tentativas = 0;
+
+            fim = ler( *atual );
+            atual->seq = seq++;
 
+            trabalho.try_push( atual ); // nunca cheia: cabe todos os lotes
+        }
+
+        pipeline.esperas_leitor = esperas;
+        total_lotes.store( seq, std::memory_order_release );
+        for( unsigned k = 0; k < jobs; ++k )
+            trabalho.try_push( nullptr ); // fim, um para cada worker
+    } );
+
+    //=== Workers: parsing e avaliação de um lote inteiro.
+    std::vector< std::thread > workers;
+    for( unsigned k = 0; k < jobs; ++k ){
+        workers.emplace_back( [&, k]{
+            Stats::Coleta coleta;
+            Parser & my_parser = *parsers[k];
+            my_parser.emit_postfix( true );
+            Optimizer my_opt;
+            VM my_vm;
+            ResultCache * cache = usar_cache ? &caches[k] : nullptr;
+
+            size_t esperas = 0;
+            unsigned tentativas = 0;
+            for( ;; ){
+                Lote * atual;
+                while ( not trabalho.try_pop( atual ) ){
+                    ++esperas;
+                    esperar( tentativas );
+                }
+                tentativas = 0;
+                if ( atual == nullptr )
+                    break;
+
+                // Os registros antigos apontam para a arena: saem antes do reset.
+                atual->records.clear();
+                atual->arena.reset();
+                for( size_t i = 0; i < atual->n; ++i )
+                    atual->records.emplace_back( &atual->arena );
+
+                for( size_t i = 0; i < atual->n; ++i ){
+                    std::string_view expr( atual->linhas[i] );
+                    auto & rec = atual->records[i];
+                    if ( cache and consultarCache( *cache, expr, rec ) )
+                        continue;
+                    processarLinha( expr, rec, my_parser, my_opt, my_vm, false );
+                    if ( cache )
+                        cache->store( expr, rec );
+                }
+
+                prontos.try_push( atual ); // nunca cheia: cabe todos os lotes
+            }
+            esperas_workers.fetch_add( esperas, std::memory_order_relaxed );
+        } );
     }
 
-    arqsaida.close();
+    //=== Escritor (esta thread): grava os lotes na ordem da entrada.
+    std::vector< Lote * > fora_de_ordem( n_lotes, nullptr );
+    size_t proximo = 0;
+    unsigned tentativas = 0;
+    while ( proximo != total_lotes.load( std::memory_order_acquire ) ){
+
+        Lote * atual;
+        if ( not prontos.try_pop( atual ) ){
+            ++pipeline.esperas_escritor;
+            esperar( tentativas );
+            continue;
+        }
+        tentativas = 0;
+
+        // A profundidade das filas mostra qual estágio é o gargalo.
+        size_t d_trabalho = trabalho.size_approx();
+        size_t d_prontos = prontos.size_approx();
+        ++pipeline.amostras;
+        pipeline.soma_trabalho += d_trabalho;
+        pipeline.soma_prontos += d_prontos;
+        pipeline.max_trabalho = std::max( pipeline.max_trabalho, d_trabalho );
+        pipeline.max_prontos = std::max( pipeline.max_prontos, d_prontos );
+
+        // No máximo n_lotes estão em circulação, então seq % n_lotes não colide.
+        fora_de_ordem[ atual->seq % n_lotes ] = atual;
+        while ( ( atual = fora_de_ordem[ proximo % n_lotes ] ) != nullptr ){
+            for( size_t i = 0; i < atual->n; ++i ){
+                if ( verbosity == verbosity_t::ERRORS )
+                    apresentarErro( atual->records[i], atual->linhas[i] );
+                escreverRegistro( arqsaida, atual->records[i] );
+                arqsaida << "\n";
+            }
+            fora_de_ordem[ proximo % n_lotes ] = nullptr;
+            livres.try_push( atual );
+            ++proximo;
+        }
+    }
 
-}
\ No newline at end of file
+    leitor.join();
+    for( auto & w : workers )
+        w.join();
+
+    pipeline.lotes = proximo;
+    pipeline.esperas_workers = esperas_workers.load();
+
+    return 1;
+
+}
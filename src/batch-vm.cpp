@@ -0,0 +1,316 @@
+/**
+ * @file    batch-vm.cpp
+ * @brief   Código fonte da máquina virtual colunar e dos seus kernels
+            (AVX2, SSE4.1 e escalar).
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <algorithm> // std::min, std::fill_n, std::copy_n
+#include <string>    // std::string
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h> // intrinsics AVX2/SSE
+#define BARES_X86 1
+#endif
+
+#include "batch-vm.h"   // classe BatchVM.
+#include "arithmetic.h" // op_add, op_sub, ...
+
+
+////////////////////////////////////////////////////////////////////////////
+// Kernels
+////////////////////////////////////////////////////////////////////////////
+
+// Todos os kernels calculam a[i] = a[i] <op> b[i] para i em [0, n) e,
+// nas linhas em que a operação dá overflow, registram o erro em err[i]
+// (só se a linha ainda não tinha erro: vale o primeiro, como na VM).
+
+/**
+ * @brief Registra o erro de uma linha, se ela ainda não tinha um.
+ * @param err Erros das linhas.
+ * @param i Linha.
+ * @param code Código do erro.
+ */
+static inline void marca( std::uint8_t * err, size_t i, EvalResult::code_t code ){
+    if ( err[i] == EvalResult::EVAL_OK )
+        err[i] = code;
+}
+
+static void add_scalar( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    for( size_t i = 0; i < n; ++i )
+        if ( auto e = op_add( a[i], b[i], a[i] ) )
+            marca( err, i, e );
+}
+
+static void sub_scalar( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    for( size_t i = 0; i < n; ++i )
+        if ( auto e = op_sub( a[i], b[i], a[i] ) )
+            marca( err, i, e );
+}
+
+static void mul_scalar( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    for( size_t i = 0; i < n; ++i )
+        if ( auto e = op_mul( a[i], b[i], a[i] ) )
+            marca( err, i, e );
+}
+
+#ifdef BARES_X86
+
+// Overflow da soma: o sinal do resultado difere do sinal dos dois
+// operandos, ou seja, o bit de sinal de (a^r) & (b^r) está ligado.
+// Na subtração, o teste é (a^b) & (a^r). Com movemask_pd os bits de
+// sinal de cada linha saem direto numa máscara de inteiros.
+//
+// Multiplicação: não existe produto 64x64 em AVX2/SSE, mas se os dois
+// operandos cabem em 32 bits com sinal o produto de _mul_epi32 é exato.
+// Um valor cabe em 32 bits quando (v + 2^31) >> 32 é zero. Vetores com
+// algum operando maior caem no caminho escalar, que detecta o overflow.
+
+__attribute__(( target( "avx2" ) ))
+static void add_avx2( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ){
+        __m256i x = _mm256_loadu_si256( (const __m256i *)( a + i ) );
+        __m256i y = _mm256_loadu_si256( (const __m256i *)( b + i ) );
+        __m256i r = _mm256_add_epi64( x, y );
+        __m256i of = _mm256_and_si256( _mm256_xor_si256( x, r ), _mm256_xor_si256( y, r ) );
+        _mm256_storeu_si256( (__m256i *)( a + i ), r );
+        int m = _mm256_movemask_pd( _mm256_castsi256_pd( of ) );
+        if ( BARES_UNLIKELY( m ) )
+            for( int l = 0; l < 4; ++l )
+                if ( m >> l & 1 )
+                    marca( err, i + l, EvalResult::NUMERIC_OVERFLOW );
+    }
+    add_scalar( a + i, b + i, n - i, err + i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void sub_avx2( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ){
+        __m256i x = _mm256_loadu_si256( (const __m256i *)( a + i ) );
+        __m256i y = _mm256_loadu_si256( (const __m256i *)( b + i ) );
+        __m256i r = _mm256_sub_epi64( x, y );
+        __m256i of = _mm256_and_si256( _mm256_xor_si256( x, y ), _mm256_xor_si256( x, r ) );
+        _mm256_storeu_si256( (__m256i *)( a + i ), r );
+        int m = _mm256_movemask_pd( _mm256_castsi256_pd( of ) );
+        if ( BARES_UNLIKELY( m ) )
+            for( int l = 0; l < 4; ++l )
+                if ( m >> l & 1 )
+                    marca( err, i + l, EvalResult::NUMERIC_OVERFLOW );
+    }
+    sub_scalar( a + i, b + i, n - i, err + i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void mul_avx2( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    const __m256i bias = _mm256_set1_epi64x( 0x80000000LL );
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ){
+        __m256i x = _mm256_loadu_si256( (const __m256i *)( a + i ) );
+        __m256i y = _mm256_loadu_si256( (const __m256i *)( b + i ) );
+        __m256i alto = _mm256_or_si256( _mm256_srli_epi64( _mm256_add_epi64( x, bias ), 32 ),
+                                        _mm256_srli_epi64( _mm256_add_epi64( y, bias ), 32 ) );
+        if ( BARES_UNLIKELY( not _mm256_testz_si256( alto, alto ) ) ){
+            mul_scalar( a + i, b + i, 4, err + i );
+            continue;
+        }
+        _mm256_storeu_si256( (__m256i *)( a + i ), _mm256_mul_epi32( x, y ) );
+    }
+    mul_scalar( a + i, b + i, n - i, err + i );
+}
+
+__attribute__(( target( "sse4.1" ) ))
+static void add_sse( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ){
+        __m128i x = _mm_loadu_si128( (const __m128i *)( a + i ) );
+        __m128i y = _mm_loadu_si128( (const __m128i *)( b + i ) );
+        __m128i r = _mm_add_epi64( x, y );
+        __m128i of = _mm_and_si128( _mm_xor_si128( x, r ), _mm_xor_si128( y, r ) );
+        _mm_storeu_si128( (__m128i *)( a + i ), r );
+        int m = _mm_movemask_pd( _mm_castsi128_pd( of ) );
+        if ( BARES_UNLIKELY( m ) )
+            for( int l = 0; l < 2; ++l )
+                if ( m >> l & 1 )
+                    marca( err, i + l, EvalResult::NUMERIC_OVERFLOW );
+    }
+    add_scalar( a + i, b + i, n - i, err + i );
+}
+
+__attribute__(( target( "sse4.1" ) ))
+static void sub_sse( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ){
+        __m128i x = _mm_loadu_si128( (const __m128i *)( a + i ) );
+        __m128i y = _mm_loadu_si128( (const __m128i *)( b + i ) );
+        __m128i r = _mm_sub_epi64( x, y );
+        __m128i of = _mm_and_si128( _mm_xor_si128( x, y ), _mm_xor_si128( x, r ) );
+        _mm_storeu_si128( (__m128i *)( a + i ), r );
+        int m = _mm_movemask_pd( _mm_castsi128_pd( of ) );
+        if ( BARES_UNLIKELY( m ) )
+            for( int l = 0; l < 2; ++l )
+                if ( m >> l & 1 )
+                    marca( err, i + l, EvalResult::NUMERIC_OVERFLOW );
+    }
+    sub_scalar( a + i, b + i, n - i, err + i );
+}
+
+__attribute__(( target( "sse4.1" ) ))
+static void mul_sse( Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    const __m128i bias = _mm_set1_epi64x( 0x80000000LL );
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ){
+        __m128i x = _mm_loadu_si128( (const __m128i *)( a + i ) );
+        __m128i y = _mm_loadu_si128( (const __m128i *)( b + i ) );
+        __m128i alto = _mm_or_si128( _mm_srli_epi64( _mm_add_epi64( x, bias ), 32 ),
+                                     _mm_srli_epi64( _mm_add_epi64( y, bias ), 32 ) );
+        if ( BARES_UNLIKELY( not _mm_testz_si128( alto, alto ) ) ){
+            mul_scalar( a + i, b + i, 2, err + i );
+            continue;
+        }
+        _mm_storeu_si128( (__m128i *)( a + i ), _mm_mul_epi32( x, y ) );
+    }
+    mul_scalar( a + i, b + i, n - i, err + i );
+}
+
+#endif
+
+/**
+ * @brief Aplica, linha a linha, uma operação do núcleo aritmético escalar.
+ * @param op Operação (op_div, op_mod ou op_pow).
+ * @param a Primeiro operando de cada linha; recebe o resultado.
+ * @param b Segundo operando de cada linha.
+ * @param n Número de linhas.
+ * @param err Erros das linhas.
+ */
+template < typename Op >
+static void escalar( Op op, Token::value_type * a, const Token::value_type * b, size_t n, std::uint8_t * err ){
+    for( size_t i = 0; i < n; ++i )
+        if ( auto e = op( a[i], b[i], a[i] ) )
+            marca( err, i, e );
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// BatchVM
+////////////////////////////////////////////////////////////////////////////
+
+/** @brief Cria a máquina e escolhe os kernels para a CPU atual. */
+BatchVM::BatchVM()
+    : k_add( add_scalar )
+    , k_sub( sub_scalar )
+    , k_mul( mul_scalar )
+    , nome_isa( "scalar" )
+{
+#ifdef BARES_X86
+    if ( __builtin_cpu_supports( "avx2" ) ){
+        k_add = add_avx2; k_sub = sub_avx2; k_mul = mul_avx2;
+        nome_isa = "avx2";
+    }
+    else if ( __builtin_cpu_supports( "sse4.1" ) ){
+        k_add = add_sse; k_sub = sub_sse; k_mul = mul_sse;
+        nome_isa = "sse4.1";
+    }
+#endif
+}
+
+/** @brief Troca os kernels pelos de um conjunto de instruções.
+    @param isa_ "avx2", "sse4.1" ou "scalar".
+    @return false se a CPU ou o build não têm esse conjunto. */
+bool BatchVM::forcar( const char * isa_ ){
+    const std::string nome( isa_ );
+    if ( nome == "scalar" ){
+        k_add = add_scalar; k_sub = sub_scalar; k_mul = mul_scalar;
+        nome_isa = "scalar";
+        return true;
+    }
+#ifdef BARES_X86
+    if ( nome == "avx2" and __builtin_cpu_supports( "avx2" ) ){
+        k_add = add_avx2; k_sub = sub_avx2; k_mul = mul_avx2;
+        nome_isa = "avx2";
+        return true;
+    }
+    if ( nome == "sse4.1" and __builtin_cpu_supports( "sse4.1" ) ){
+        k_add = add_sse; k_sub = sub_sse; k_mul = mul_sse;
+        nome_isa = "sse4.1";
+        return true;
+    }
+#endif
+    return false;
+}
+
+/** @brief Executa um programa para n_ linhas.
+    @param prog_ Programa compilado.
+    @param cols_ Para cada variável (pelo índice), um vetor com o
+           valor dela em cada uma das n_ linhas.
+    @param n_ Número de linhas.
+    @param values_ Recebe o valor de cada linha.
+    @param errors_ Recebe o código do erro de cada linha
+           (EvalResult::EVAL_OK se não houve erro). */
+void BatchVM::run( const Program & prog_, const Token::value_type * const * cols_, size_t n_,
+                   Token::value_type * values_, std::uint8_t * errors_ )
+{
+    typedef Instruction::opcode_t opcode_t;
+
+    if ( stack.size() < prog_.max_depth * BLOCO )
+        stack.resize( prog_.max_depth * BLOCO );
+
+    // Coluna k da pilha: stack[ k * BLOCO, (k+1) * BLOCO ).
+    auto coluna = [this]( size_t k ){ return stack.data() + k * BLOCO; };
+
+    for( size_t base = 0; base < n_; base += BLOCO ){
+
+        const size_t m = std::min( BLOCO, n_ - base );
+        std::uint8_t * err = errors_ + base;
+        std::fill_n( err, m, std::uint8_t( EvalResult::EVAL_OK ) );
+
+        size_t sp = 0; // Próxima coluna livre.
+
+        for( const auto & ins : prog_.code ){
+            switch( ins.op )
+            {
+                case opcode_t::PUSH:
+                    std::fill_n( coluna( sp++ ), m, ins.imm );
+                    break;
+                case opcode_t::LOAD:
+                    std::copy_n( cols_[ ins.imm ] + base, m, coluna( sp++ ) );
+                    break;
+                case opcode_t::ADD:
+                    --sp;
+                    k_add( coluna( sp - 1 ), coluna( sp ), m, err );
+                    break;
+                case opcode_t::SUB:
+                    --sp;
+                    k_sub( coluna( sp - 1 ), coluna( sp ), m, err );
+                    break;
+                case opcode_t::MUL:
+                    --sp;
+                    k_mul( coluna( sp - 1 ), coluna( sp ), m, err );
+                    break;
+                case opcode_t::SQR:
+                    k_mul( coluna( sp - 1 ), coluna( sp - 1 ), m, err );
+                    break;
+                case opcode_t::DIV:
+                    --sp;
+                    escalar( op_div, coluna( sp - 1 ), coluna( sp ), m, err );
+                    break;
+                case opcode_t::MOD:
+                    --sp;
+                    escalar( op_mod, coluna( sp - 1 ), coluna( sp ), m, err );
+                    break;
+                case opcode_t::POW:
+                    --sp;
+                    escalar( op_pow, coluna( sp - 1 ), coluna( sp ), m, err );
+                    break;
+            }
+        }
+
+        // Linhas com erro ficam com valor zero, como em VM::run.
+        const Token::value_type * topo = coluna( 0 );
+        for( size_t i = 0; i < m; ++i )
+            values_[ base + i ] = err[i] == EvalResult::EVAL_OK ? topo[i] : 0;
+    }
+}
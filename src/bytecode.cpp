@@ -0,0 +1,340 @@
+/**
+ * @file    bytecode.cpp
+ * @brief   Código fonte com o compilador de expressões postfix para
+            bytecode e a máquina virtual que o executa.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <cassert>  // assert
+
+#include "bytecode.h"   // Program, VM.
+#include "arithmetic.h" // op_add, op_sub, ...
+
+
+/** @brief Compila uma expressão postfix para bytecode.
+    @param postfix_ Tokens da expressão no formato postfix.
+    @param prog_ Recebe o programa (o buffer de instruções é reaproveitado). */
+void compile( const TokenList & postfix_, Program & prog_ )
+{
+    prog_.code.clear();
+    prog_.code.reserve( postfix_.size() );
+    prog_.max_depth = 0;
+
+    size_t depth( 0 );
+
+    for( const auto & tk : postfix_ ){
+
+        Instruction ins;
+        ins.imm = 0;
+
+        if ( tk.type == Token::token_t::OPERAND or tk.type == Token::token_t::VARIABLE )
+        {
+            ins.op  = tk.type == Token::token_t::OPERAND ? Instruction::opcode_t::PUSH
+                                                         : Instruction::opcode_t::LOAD;
+            ins.imm = tk.value;
+            if ( ++depth > prog_.max_depth )
+                prog_.max_depth = depth;
+        }
+        else
+        {
+            switch( tk.op )
+            {
+                case Token::operator_t::PLUS           : ins.op = Instruction::opcode_t::ADD; break;
+                case Token::operator_t::MINUS          : ins.op = Instruction::opcode_t::SUB; break;
+                case Token::operator_t::MULTIPLICATION : ins.op = Instruction::opcode_t::MUL; break;
+                case Token::operator_t::DIVISION       : ins.op = Instruction::opcode_t::DIV; break;
+                case Token::operator_t::REST           : ins.op = Instruction::opcode_t::MOD; break;
+                case Token::operator_t::POTENTIATION   : ins.op = Instruction::opcode_t::POW; break;
+                default: assert(false);
+            }
+            // Todo operador binário consome dois valores e produz um.
+            --depth;
+        }
+
+        prog_.code.push_back( ins );
+    }
+}
+
+
+/**
+ * @brief Aplica um operador binário a dois valores.
+ * @param op Código da operação (ADD ... POW).
+ * @param n1 Primeiro operando.
+ * @param n2 Segundo operando.
+ * @param r_ Recebe o resultado.
+ * @return Código do erro (EVAL_OK se não houve erro).
+ */
+static EvalResult::code_t apply( Instruction::opcode_t op, Token::value_type n1, Token::value_type n2, Token::value_type & r_ )
+{
+    switch( op )
+    {
+        case Instruction::opcode_t::ADD : return op_add( n1, n2, r_ );
+        case Instruction::opcode_t::SUB : return op_sub( n1, n2, r_ );
+        case Instruction::opcode_t::MUL : return op_mul( n1, n2, r_ );
+        case Instruction::opcode_t::DIV : return op_div( n1, n2, r_ );
+        case Instruction::opcode_t::MOD : return op_mod( n1, n2, r_ );
+        case Instruction::opcode_t::POW : return op_pow( n1, n2, r_ );
+        default: assert(false);
+    }
+    // Não é um operador binário: devolve erro, para que nada seja dobrado.
+    return EvalResult::NUMERIC_OVERFLOW;
+}
+
+
+/** @brief Otimiza um programa no próprio buffer de instruções.
+    O código é reescrito da esquerda para a direita: a posição de escrita
+    nunca passa a de leitura, pois cada regra só remove ou troca
+    instruções. Uma constante descartada no meio do código (0+x, 1*x)
+    só é marcada como morta, sem deslocar o código de x, e as mortas
+    saem numa única compactação no final: o passo é linear mesmo com
+    milhares dessas identidades aninhadas. A ordem das sub-expressões
+    que restam não muda, então erros de execução continuam aparecendo
+    na mesma ordem.
+    @param prog_ Programa compilado (max_depth é recalculado).
+    @return Número de nós (instruções) removidos. */
+size_t Optimizer::run( Program & prog_ )
+{
+    typedef Instruction::opcode_t opcode_t;
+
+    auto & code = prog_.code;
+    nodes.clear();
+    mortas.assign( code.size(), 0 );
+
+    size_t w( 0 ); // Próxima posição de escrita.
+
+    // Toda escrita revive a posição, que pode ter sido marcada como morta
+    // antes de a sub-expressão dela ser descartada.
+    auto grava = [&]( size_t pos_, opcode_t op_, Token::value_type imm_ ){
+        code[ pos_ ].op = op_;
+        code[ pos_ ].imm = imm_;
+        mortas[ pos_ ] = 0;
+    };
+
+    for( size_t r = 0; r < code.size(); ++r ){
+
+        const Instruction ins = code[r];
+
+        if ( ins.op == opcode_t::PUSH or ins.op == opcode_t::LOAD ){
+            nodes.push_back( Node{ w, ins.op == opcode_t::PUSH, true } );
+            grava( w++, ins.op, ins.imm );
+            continue;
+        }
+
+        // SQR (de um programa já otimizado) é unário: fica como está.
+        if ( ins.op == opcode_t::SQR ){
+            nodes.back().constant = false;
+            nodes.back().unico = false;
+            grava( w++, ins.op, ins.imm );
+            continue;
+        }
+
+        // O código de 'a' ocupa [a.begin, b.begin) e o de 'b', [b.begin, w).
+        const Node b = nodes.back(); nodes.pop_back();
+        const Node a = nodes.back(); nodes.pop_back();
+
+        // (1) Dois operandos constantes: a operação vira um único PUSH,
+        // a menos que ela dê erro (o erro fica para a execução).
+        if ( a.constant and b.constant ){
+            Token::value_type v( 0 );
+            if ( apply( ins.op, code[a.begin].imm, code[b.begin].imm, v ) == EvalResult::EVAL_OK ){
+                w = a.begin;
+                grava( w, opcode_t::PUSH, v );
+                nodes.push_back( Node{ w++, true, true } );
+                continue;
+            }
+        }
+        // (2) Constante à direita: x+0, x-0, x*1, x/1, x^1, x^2 e x*0.
+        else if ( b.constant ){
+            auto k = code[b.begin].imm;
+
+            if ( ( k == 0 and ( ins.op == opcode_t::ADD or ins.op == opcode_t::SUB ) ) or
+                 ( k == 1 and ( ins.op == opcode_t::MUL or ins.op == opcode_t::DIV or ins.op == opcode_t::POW ) ) ){
+                w = b.begin; // Descarta o PUSH da constante: sobra x.
+                nodes.push_back( a );
+                continue;
+            }
+            if ( k == 2 and ins.op == opcode_t::POW ){
+                grava( b.begin, opcode_t::SQR, 0 ); // O PUSH 2 dá lugar ao SQR.
+                nodes.push_back( Node{ a.begin, false, false } );
+                continue;
+            }
+            // x*0 só é seguro quando x é um único operando (não pode dar erro).
+            if ( k == 0 and ins.op == opcode_t::MUL and a.unico ){
+                w = a.begin;
+                grava( w, opcode_t::PUSH, 0 );
+                nodes.push_back( Node{ w++, true, true } );
+                continue;
+            }
+        }
+        // (3) Constante à esquerda: 0+x, 1*x e 0*x.
+        else if ( a.constant ){
+            auto k = code[a.begin].imm;
+
+            if ( ( k == 0 and ins.op == opcode_t::ADD ) or ( k == 1 and ins.op == opcode_t::MUL ) ){
+                // O PUSH da constante morre no lugar; o código de x não se move.
+                mortas[ a.begin ] = 1;
+                nodes.push_back( Node{ a.begin, false, b.unico } );
+                continue;
+            }
+            if ( k == 0 and ins.op == opcode_t::MUL and b.unico ){
+                w = a.begin;
+                grava( w, opcode_t::PUSH, 0 );
+                nodes.push_back( Node{ w++, true, true } );
+                continue;
+            }
+        }
+
+        // Nenhuma regra se aplica: a operação fica como está.
+        grava( w++, ins.op, ins.imm );
+        nodes.push_back( Node{ a.begin, false, false } );
+    }
+
+    // Compacta: as instruções vivas descem, na mesma ordem.
+    size_t n( 0 );
+    for( size_t i = 0; i < w; ++i )
+        if ( not mortas[i] )
+            code[ n++ ] = code[i];
+
+    const size_t removed = code.size() - n;
+    code.resize( n );
+
+    // Recalcula a profundidade máxima da pilha do programa otimizado.
+    size_t depth( 0 );
+    prog_.max_depth = 0;
+    for( const auto & ins : code ){
+        if ( ins.op == opcode_t::PUSH or ins.op == opcode_t::LOAD ){
+            if ( ++depth > prog_.max_depth )
+                prog_.max_depth = depth;
+        }
+        else if ( ins.op != opcode_t::SQR )
+            --depth;
+    }
+
+    return removed;
+}
+
+
+/** @brief Executa um programa.
+    @param prog_ Programa compilado.
+    @param vars_ Valor de cada variável, pelo índice (só é lido
+           por programas com variáveis).
+    @return Resultado da avaliação. */
+EvalResult VM::run( const Program & prog_, const Token::value_type * vars_ )
+{
+    // A pilha é dimensionada uma única vez pela profundidade calculada
+    // na compilação; daí em diante o laço não faz verificação de limite.
+    if ( stack.size() < prog_.max_depth )
+        stack.resize( prog_.max_depth );
+
+    Token::value_type * sp = stack.data(); // Próxima posição livre.
+
+    for( const auto & ins : prog_.code ){
+        switch( ins.op )
+        {
+            case Instruction::opcode_t::PUSH:
+                *sp++ = ins.imm;
+                break;
+            case Instruction::opcode_t::LOAD:
+                *sp++ = vars_[ ins.imm ];
+                break;
+            case Instruction::opcode_t::ADD:
+                --sp;
+                if ( auto e = op_add( sp[-1], sp[0], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+            case Instruction::opcode_t::SUB:
+                --sp;
+                if ( auto e = op_sub( sp[-1], sp[0], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+            case Instruction::opcode_t::MUL:
+                --sp;
+                if ( auto e = op_mul( sp[-1], sp[0], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+            case Instruction::opcode_t::DIV:
+                --sp;
+                if ( auto e = op_div( sp[-1], sp[0], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+            case Instruction::opcode_t::MOD:
+                --sp;
+                if ( auto e = op_mod( sp[-1], sp[0], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+            case Instruction::opcode_t::POW:
+                --sp;
+                if ( auto e = op_pow( sp[-1], sp[0], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+            case Instruction::opcode_t::SQR:
+                if ( auto e = op_mul( sp[-1], sp[-1], sp[-1] ) )
+                    return EvalResult( e );
+                break;
+        }
+    }
+
+    return EvalResult( EvalResult::EVAL_OK, sp[-1] );
+}
+
+
+/** @brief Executa um programa mostrando cada operação realizada.
+    Caminho lento, usado apenas para depuração.
+    @param prog_ Programa compilado.
+    @param os_ Fluxo onde as operações são impressas.
+    @param vars_ Valor de cada variável, pelo índice.
+    @return Resultado da avaliação. */
+EvalResult VM::trace( const Program & prog_, std::ostream & os_, const Token::value_type * vars_ )
+{
+    static const char symbols[] = "?+-*/%^";
+
+    Program passo;            // Programa de uma única operação.
+    passo.max_depth = 2;
+
+    std::vector< Token::value_type > s;
+
+    for( const auto & ins : prog_.code ){
+
+        if ( ins.op == Instruction::opcode_t::PUSH ){
+            s.push_back( ins.imm );
+            continue;
+        }
+        if ( ins.op == Instruction::opcode_t::LOAD ){
+            s.push_back( vars_[ ins.imm ] );
+            continue;
+        }
+
+        // Reaproveita o caminho rápido para a operação em si, assim as
+        // duas execuções nunca divergem.
+        if ( ins.op == Instruction::opcode_t::SQR ){
+            auto op1 = s.back(); s.pop_back();
+
+            os_ << ">>> Performing " << op1 << " ^ 2\n";
+
+            passo.code.resize( 2 );
+            passo.code[0].op = Instruction::opcode_t::PUSH; passo.code[0].imm = op1;
+            passo.code[1] = ins;
+        }
+        else {
+            // Recupera os dois operandos na ordem inversa
+            auto op2 = s.back(); s.pop_back();
+            auto op1 = s.back(); s.pop_back();
+
+            os_ << ">>> Performing " << op1 << " " << symbols[ (int)ins.op ] << " " << op2 << "\n";
+
+            passo.code.resize( 3 );
+            passo.code[0].op = Instruction::opcode_t::PUSH; passo.code[0].imm = op1;
+            passo.code[1].op = Instruction::opcode_t::PUSH; passo.code[1].imm = op2;
+            passo.code[2] = ins;
+        }
+
+        auto result = run( passo );
+        if ( result.type != EvalResult::EVAL_OK )
+            return result;
+        s.push_back( result.value );
+    }
+
+    return EvalResult( EvalResult::EVAL_OK, s.back() );
+}
@@ -9,51 +9,305 @@
 #include <iostream>
 #include <vector>
 #include <iterator>
+#include <string>
+#include <fstream>
+#include <cstdlib>
+#include <charconv>
+#include <climits>
 
 #include "bares-manager.h"
+#include "server.h"
 #include "token.h"
 
+
+/**
+*@brief Mostra como usar o programa.
+*@param prog Nome do executável.
+*/
+void usage( const char * prog ){
+    std::cerr << "Uso: " << prog << " [--jobs N] [--stream | --pipeline] [--cache N] [--verbosity NIVEL | -q] <arquivo | ->\n"
+              << "   ou: " << prog << " --template EXPRESSAO --bindings <arquivo.csv | ->\n"
+              << "   ou: " << prog << " --server SOCKET\n"
+              << "  --jobs N           avalia as expressoes em N threads\n"
+              << "  --stream           le, avalia e grava em blocos, com memoria constante\n"
+              << "  --pipeline         como --stream, mas leitura, avaliacao (em N threads) e\n"
+              << "                     gravacao rodam ao mesmo tempo, em estagios; com\n"
+              << "                     --verbosity errors ou --stats, mostra em stderr a\n"
+              << "                     ocupacao das filas e as esperas de cada estagio\n"
+              << "  --cache N          reaproveita o resultado de expressoes repetidas, guardando\n"
+              << "                     ate N expressoes por thread (ignorado com trace)\n"
+              << "  --verbosity NIVEL  silent, errors ou trace (padrao: trace no modo serial,\n"
+              << "                     silent com --jobs, --stream ou --cache)\n"
+              << "  -q                 o mesmo que --verbosity silent\n"
+              << "  --stats[=ARQ]      ao sair, escreve em JSON o tempo de cada estagio, os\n"
+              << "                     contadores e os histogramas de latencia (em stderr\n"
+              << "                     ou no arquivo ARQ)\n"
+              << "  -                  le as expressoes da entrada padrao (implica --stream)\n"
+              << "  --template EXPR    expressao com variaveis, compilada uma unica vez\n"
+              << "  --bindings CSV     avalia o template para cada linha do CSV; o cabecalho\n"
+              << "                     traz o nome das variaveis\n"
+              << "  --server SOCKET    atende expressoes (uma por linha) num socket Unix e\n"
+              << "                     responde uma linha por expressao, ate SIGINT/SIGTERM\n";
+}
+
+/**
+*@brief Lê um número natural de um argumento da linha de comando.
+*@param texto Argumento; só dígitos, sem sinal.
+*@param n Recebe o valor lido.
+*@return false se o texto não é um número ou não cabe em size_t.
+*/
+bool lerNumero( const std::string & texto, size_t & n ){
+    if ( texto.empty() or texto[0] < '0' or texto[0] > '9' )
+        return false;
+    auto r = std::from_chars( texto.data(), texto.data() + texto.size(), n );
+    return r.ec == std::errc() and r.ptr == texto.data() + texto.size();
+}
+
+/**
+*@brief Mostra os contadores do cache de resultados, se ele foi usado.
+*@param manager Gerenciador que processou a entrada.
+*@param cache Capacidade do cache (0: sem cache).
+*@param verbosity Nível de mensagens escolhido.
+*/
+void estatisticasCache( const BaresManager & manager, size_t cache, int verbosity ){
+    if ( cache == 0 or verbosity == (int) BaresManager::verbosity_t::SILENT )
+        return;
+    if ( verbosity == (int) BaresManager::verbosity_t::TRACE ){
+        std::cerr << ">>> Cache: desligado (ignorado com --verbosity trace)\n";
+        return;
+    }
+    std::cerr << ">>> Cache: " << manager.cache_hits() << " hits, "
+              << manager.cache_misses() << " misses\n";
+}
+
+/**
+*@brief Mostra a profundidade das filas e as esperas de cada estágio do pipeline.
+*@param manager Gerenciador que processou a entrada.
+*/
+void estatisticasPipeline( const BaresManager & manager ){
+    const auto & p = manager.estatisticas_pipeline();
+    double amostras = p.amostras ? p.amostras : 1;
+    std::cerr << ">>> Pipeline: " << p.lotes << " lotes\n"
+              << ">>>   fila leitor -> workers: media " << p.soma_trabalho / amostras
+              << ", max " << p.max_trabalho << "\n"
+              << ">>>   fila workers -> escritor: media " << p.soma_prontos / amostras
+              << ", max " << p.max_prontos << "\n"
+              << ">>>   esperas: leitor " << p.esperas_leitor << ", workers " << p.esperas_workers
+              << ", escritor " << p.esperas_escritor << "\n";
+}
+
+/**
+ *  Escreve o relatório de --stats ao sair de main(), por qualquer caminho.
+ */
+struct RelatorioStats {
+    const char * destino = nullptr; //<! Arquivo do relatório ("" para stderr; nullptr: sem --stats).
+
+    ~RelatorioStats(){
+        if ( destino == nullptr )
+            return;
+        if ( not BARES_STATS )
+            std::cerr << ">>> --stats: instrumentacao desligada neste build (BARES_STATS=OFF)\n";
+        if ( *destino == '\0' ){
+            Stats::escreverJson( std::cerr );
+            return;
+        }
+        std::ofstream arq( destino, std::ios::out );
+        if ( arq.is_open() )
+            Stats::escreverJson( arq );
+        else
+            std::cerr << ">>> Nao foi possivel criar \"" << destino << "\"\n";
+    }
+};
+
 /**
 *@brief Função principal que contém toda a execução do programa.
 */
 int main( int argc, char * argv[] ){
 
-    std::vector< std::vector< Token > > postfix;
-    int result;
-    std::vector< int > resultados;
+    char * arquivo = nullptr;
+    unsigned jobs = 0; // 0: modo serial, com saída detalhada no console
+    bool stream = false;
+    bool pipeline = false;
+    size_t cache = 0; // 0: sem cache de resultados
+    const char * formula = nullptr;  // --template
+    const char * bindings = nullptr; // --bindings
+    const char * socket = nullptr;   // --server
+    int verbosity = -1; // -1: usa o padrão do modo escolhido
+    const char * stats = nullptr; // --stats
+
+    // ler opcoes da linha de comando
+    for( int i = 1; i < argc; ++i ){
+        std::string arg( argv[i] );
+        if ( arg == "--jobs" and i + 1 < argc ){
+            size_t n;
+            if ( not lerNumero( argv[++i], n ) or n == 0 or n > UINT_MAX ){
+                usage( argv[0] );
+                return 1;
+            }
+            jobs = static_cast< unsigned >( n );
+        }
+        else if ( arg == "--cache" and i + 1 < argc ){
+            if ( not lerNumero( argv[++i], cache ) ){
+                usage( argv[0] );
+                return 1;
+            }
+        }
+        else if ( arg == "--template" and i + 1 < argc ){
+            formula = argv[++i];
+        }
+        else if ( arg == "--bindings" and i + 1 < argc ){
+            bindings = argv[++i];
+        }
+        else if ( arg == "--server" and i + 1 < argc ){
+            socket = argv[++i];
+        }
+        else if ( arg == "--stream" ){
+            stream = true;
+        }
+        else if ( arg == "--pipeline" ){
+            pipeline = true;
+        }
+        else if ( arg == "--stats" ){
+            stats = "";
+        }
+        else if ( arg.compare( 0, 8, "--stats=" ) == 0 ){
+            stats = argv[i] + 8;
+        }
+        else if ( arg == "-q" ){
+            verbosity = (int) BaresManager::verbosity_t::SILENT;
+        }
+        else if ( arg == "--verbosity" and i + 1 < argc ){
+            std::string nivel( argv[++i] );
+            if ( nivel == "silent" )      verbosity = (int) BaresManager::verbosity_t::SILENT;
+            else if ( nivel == "errors" ) verbosity = (int) BaresManager::verbosity_t::ERRORS;
+            else if ( nivel == "trace" )  verbosity = (int) BaresManager::verbosity_t::TRACE;
+            else {
+                usage( argv[0] );
+                return 1;
+            }
+        }
+        else if ( arquivo == nullptr ){
+            arquivo = argv[i];
+        }
+        else {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+
+    // A coleta começa antes de qualquer estágio (e de qualquer thread);
+    // o relatório sai no fim de main(), depois de tudo.
+    if ( stats != nullptr )
+        Stats::ligar();
+    Stats::Coleta coleta;
+    RelatorioStats relatorio;
+    relatorio.destino = stats;
 
     // instanciar um manager
     BaresManager manager;
 
-    // inicializar bares... Ler e guardar expressoes do arquivo de entrada
-    manager.initialize( argv[1] );
+    // Modo servidor: as expressões chegam por um socket Unix e o
+    // parser e a VM ficam prontos entre uma requisição e outra.
+    if ( socket != nullptr ){
+        if ( arquivo != nullptr or formula != nullptr or bindings != nullptr ){
+            usage( argv[0] );
+            return 1;
+        }
+        Server servidor( manager );
+        if ( not servidor.open( socket ) ){
+            std::cerr << ">>> Nao foi possivel criar o socket \"" << socket << "\"\n";
+            return 1;
+        }
+        return servidor.run() ? 0 : 1;
+    }
+
+    // Modo template: uma expressão com variáveis avaliada para cada linha
+    // de um CSV, sem parsing por linha.
+    if ( formula != nullptr or bindings != nullptr ){
+        if ( formula == nullptr or bindings == nullptr or arquivo != nullptr ){
+            usage( argv[0] );
+            return 1;
+        }
+        std::ifstream csv;
+        if ( std::string( bindings ) != "-" ){
+            csv.open( bindings, std::ios::in );
+            if ( not csv.is_open() ){
+                std::cerr << ">>> Nao foi possivel abrir \"" << bindings << "\"\n";
+                return 1;
+            }
+        }
+        std::istream & entrada = csv.is_open() ? csv : std::cin;
+        return manager.processarBindings( formula, entrada ) ? 0 : 1;
+    }
+
+    if ( arquivo == nullptr ){
+        usage( argv[0] );
+        return 1;
+    }
+
+    // O log completo só é o padrão no modo serial tradicional.
+    if ( verbosity < 0 )
+        verbosity = (int)( jobs > 0 or stream or pipeline or cache > 0 or std::string( arquivo ) == "-"
+                           ? BaresManager::verbosity_t::SILENT
+                           : BaresManager::verbosity_t::TRACE );
+    manager.set_verbosity( (BaresManager::verbosity_t) verbosity );
+    manager.set_cache( cache );
 
-    // Validar expressoes e tokenizar
-    std::vector< std::vector< Token > > tokens = manager.validarExpress();
+    // Modo stream: a entrada é processada em blocos, sem carregar o
+    // arquivo inteiro na memória.
+    if ( stream or pipeline or std::string( arquivo ) == "-" ){
+        std::ifstream arq;
+        if ( std::string( arquivo ) != "-" ){
+            arq.open( arquivo, std::ios::in );
+            if ( not arq.is_open() ){
+                std::cerr << ">>> Nao foi possivel abrir \"" << arquivo << "\"\n";
+                return 1;
+            }
+        }
+        std::istream & entrada = arq.is_open() ? arq : std::cin;
+        if ( pipeline ){
+            if ( not manager.processarPipeline( entrada, jobs ) )
+                return 1;
+            // Com trace o pipeline cai no processarStream(): não há filas.
+            if ( verbosity == (int) BaresManager::verbosity_t::ERRORS or
+                 ( stats != nullptr and verbosity != (int) BaresManager::verbosity_t::TRACE ) )
+                estatisticasPipeline( manager );
+        }
+        else if ( not manager.processarStream( entrada, jobs ) )
+            return 1;
+        estatisticasCache( manager, cache, verbosity );
+        return 0;
+    }
 
-    // passar expressao do formato infixo para posfixo
-    for( auto tk : tokens ){
-        postfix = manager.infix_to_postfix( tk );
+    // inicializar bares... Ler e guardar expressoes do arquivo de entrada
+    if ( not manager.initialize( arquivo ) ){
+        std::cerr << ">>> Nao foi possivel abrir \"" << arquivo << "\"\n";
+        return 1;
     }
 
-    // Imprimir para usários os tokens válidos e já no formato posfixo
-    std::cout << "\nTokens válidos e no formato postfix:\n";
-    for( auto pos : postfix ){
-        std::cout << ">>> Tokens: { ";
-        std::copy( pos.begin(), pos.end(),
-        std::ostream_iterator< Token >( std::cout, " ") );
-        std::cout << "}\n";
+    if ( jobs > 0 or cache > 0 ){
+        // Linhas são independentes: parsing, conversão e avaliação em paralelo
+        // (ou numa única passada por linha, consultando o cache)
+        manager.processarParalelo( jobs );
     }
-    std::cout << "\n";
+    else {
+        // Validar expressoes e tokenizar (cada linha é analisada uma única vez)
+        manager.validarExpress();
 
+        // passar expressoes validas do formato infixo para posfixo
+        manager.converterExpress();
 
-    // encontrar resultado da expressao
-    for( auto pf : postfix ){
-        result = manager.evaluate_postfix( pf );
-        resultados.push_back( result );
+        // encontrar resultado das expressoes
+        manager.avaliarExpress();
     }
 
-    manager.apresentarResult( resultados );
+    // mensagens no console, conforme a verbosidade escolhida
+    manager.apresentarConsole();
+
+    // escrever os registros no arquivo de saída, na ordem original
+    manager.apresentarResult();
+
+    estatisticasCache( manager, cache, verbosity );
 
     return 0;
 }
\ No newline at end of file
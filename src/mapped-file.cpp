@@ -0,0 +1,95 @@
+/**
+ * @file    mapped-file.cpp
+ * @brief   Código fonte com a leitura de arquivos via mmap.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <cstring>    // memchr
+
+#include <fcntl.h>    // ::open
+#include <unistd.h>   // ::close
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <sys/stat.h> // fstat
+
+#include "mapped-file.h" // classe MappedFile.
+
+
+/** @brief Mapeia o arquivo.
+    @param arq Nome do arquivo.
+    @return 1 se o arquivo foi mapeado; 0 otherwise. */
+int MappedFile::open( const char * arq ){
+
+    close();
+
+    int fd = ::open( arq, O_RDONLY );
+    if ( fd < 0 )
+        return 0;
+
+    struct stat st;
+    if ( fstat( fd, &st ) < 0 ){
+        ::close( fd );
+        return 0;
+    }
+
+    // Arquivo vazio: não há o que mapear (mmap rejeita tamanho zero).
+    if ( st.st_size > 0 ){
+        void * p = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( p == MAP_FAILED ){
+            ::close( fd );
+            return 0;
+        }
+        // O arquivo é lido do início ao fim uma única vez.
+        madvise( p, st.st_size, MADV_SEQUENTIAL );
+
+        data = static_cast< const char * >( p );
+        size = st.st_size;
+    }
+
+    // O mapeamento continua válido depois de fechar o descritor.
+    ::close( fd );
+
+    return 1;
+}
+
+/** @brief Desfaz o mapeamento atual, se houver. */
+void MappedFile::close( void ){
+    if ( data != nullptr )
+        munmap( const_cast< char * >( data ), size );
+    data = nullptr;
+    size = 0;
+}
+
+/** @brief Recupera o conteúdo do arquivo.
+    @return View sobre todo o arquivo. */
+std::string_view MappedFile::contents( void ) const {
+    return std::string_view( data, size );
+}
+
+/** @brief Divide o conteúdo em linhas (sem o '\n').
+    Segue a regra de leitura com getline: o trecho após o último
+    '\n', mesmo vazio, também é uma linha.
+    @param linhas_ Recebe uma view por linha. */
+void MappedFile::lines( std::vector< std::string_view > & linhas_ ) const {
+
+    linhas_.clear();
+
+    const char * it  = data;
+    const char * fim = data + size;
+
+    while ( true ){
+        auto nl = static_cast< const char * >( it == fim ? nullptr : memchr( it, '\n', fim - it ) );
+        if ( nl == nullptr ){
+            linhas_.emplace_back( it, fim - it );
+            break;
+        }
+        linhas_.emplace_back( it, nl - it );
+        it = nl + 1;
+    }
+}
+
+/// Destrutor: libera o mapeamento.
+MappedFile::~MappedFile(){
+    close();
+}
@@ -8,41 +8,178 @@
  */
 
 
+#include <cstring>  // memcpy
+#include <limits>   // std::numeric_limits
+
 #include "../include/parser.h"
 
 
+////////////////////////////////////////////////////////////////////////////
+// Funcoes auxiliares: leitura de literais inteiros (SWAR)
+////////////////////////////////////////////////////////////////////////////
+
+// Os literais são lidos 8 bytes por vez dentro de um inteiro de 64 bits
+// (SWAR, "SIMD within a register"), que funciona em qualquer CPU. Na
+// cauda da expressão os bytes que faltam são preenchidos com espaços,
+// então nunca lemos além do fim da linha (que pode ser o fim do mmap).
+
+/**
+ * @brief Carrega até 8 bytes da entrada em um inteiro de 64 bits.
+ * @param p_ Início da leitura.
+ * @param end_ Fim da entrada.
+ * @return Os bytes, em ordem little-endian (o 1º char no byte baixo).
+ */
+static inline std::uint64_t load8( const char * p_, const char * end_ )
+{
+    std::uint64_t v;
+    if ( end_ - p_ >= 8 ){
+        std::memcpy( &v, p_, 8 );
+    }
+    else {
+        char buf[8] = { ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+        std::memcpy( buf, p_, end_ - p_ );
+        std::memcpy( &v, buf, 8 );
+    }
+    return v;
+}
+
+/**
+ * @brief Conta quantos dos 8 bytes, a partir do byte baixo, são dígitos.
+ * @param v_ Bytes carregados por load8().
+ * @return Número de dígitos iniciais (0 a 8).
+ */
+static inline unsigned leading_digits( std::uint64_t v_ )
+{
+    // Dígitos viram 0x00..0x09; qualquer outro byte fica >= 0x0A e, ao
+    // somar 0x76, liga o bit alto. O "vai um" só contamina bytes depois
+    // do primeiro não-dígito, que não interessam.
+    std::uint64_t t  = v_ ^ 0x3030303030303030ull;
+    std::uint64_t nd = ( ( t + 0x7676767676767676ull ) | t ) & 0x8080808080808080ull;
+
+    return nd == 0 ? 8u : static_cast< unsigned >( __builtin_ctzll( nd ) ) / 8u;
+}
+
+/**
+ * @brief Converte 8 dígitos (já sem o '0') em um valor, em três multiplicações.
+ * @param v_ Oito dígitos 0..9, o mais significativo no byte baixo.
+ * @return Valor decimal dos 8 dígitos.
+ */
+static inline std::uint64_t eight_digits( std::uint64_t v_ )
+{
+    // Junta pares de dígitos, depois pares de pares, depois as metades.
+    v_ = ( v_ * ( 1 + ( 10 << 8 ) ) ) >> 8;
+    v_ = ( ( v_ & 0x00FF00FF00FF00FFull ) * ( 1 + ( 100 << 16 ) ) ) >> 16;
+    v_ = ( ( v_ & 0x0000FFFF0000FFFFull ) * ( 1 + ( 10000ull << 32 ) ) ) >> 32;
+    return v_;
+}
+
+/// Potências de 10 que cabem em 64 bits, para juntar blocos de dígitos.
+static const std::uint64_t POW10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull
+};
+
+/**
+ * @brief Lê uma sequência de dígitos e converte para inteiro na mesma passada.
+ * @param p_ Primeiro dígito.
+ * @param end_ Fim da entrada.
+ * @param value_ Recebe o valor lido.
+ * @param overflow_ Recebe true se o valor não couber em 64 bits sem sinal.
+ * @return Ponteiro para o primeiro caractere que não é dígito.
+ */
+static inline const char * scan_digits( const char * p_, const char * end_,
+                                        std::uint64_t & value_, bool & overflow_ )
+{
+    std::uint64_t acc( 0 );
+    overflow_ = false;
+
+    while ( p_ != end_ ){
+        std::uint64_t v = load8( p_, end_ );
+        unsigned n = leading_digits( v );
+        if ( n == 0 )
+            break;
+
+        // Mantém só os n dígitos e os alinha no topo, com zeros à esquerda.
+        v = ( v - 0x3030303030303030ull ) << ( 8 * ( 8 - n ) );
+        std::uint64_t bloco = eight_digits( v );
+
+        overflow_ |= __builtin_mul_overflow( acc, POW10[n], &acc );
+        overflow_ |= __builtin_add_overflow( acc, bloco, &acc );
+
+        p_ += n;
+        if ( n < 8 )
+            break;
+    }
+
+    value_ = acc;
+    return p_;
+}
+
+
+
+
+/** @brief Monta a tabela de classificação dos 256 valores de um byte.
+    Gerada em tempo de compilação; o lexer passa a ser um único acesso
+    à tabela por caractere.
+    @return Tabela com o código do símbolo terminal de cada byte. */
+constexpr std::array< Parser::terminal_symbol_t, 256 > Parser::make_char_class( void )
+{
+    std::array< terminal_symbol_t, 256 > table{};
+
+    for( auto & c : table )
+        c = terminal_symbol_t::TS_INVALID;
+
+    table[ (unsigned char) '+' ] = terminal_symbol_t::TS_PLUS;
+    table[ (unsigned char) '-' ] = terminal_symbol_t::TS_MINUS;
+    table[ (unsigned char) '*' ] = terminal_symbol_t::TS_MULTIPLICATION;
+    table[ (unsigned char) '/' ] = terminal_symbol_t::TS_DIVISION;
+    table[ (unsigned char) '%' ] = terminal_symbol_t::TS_REST;
+    table[ (unsigned char) '^' ] = terminal_symbol_t::TS_POTENTIATION;
+    table[ (unsigned char) '(' ] = terminal_symbol_t::TS_OPENING_SCOPE;
+    table[ (unsigned char) ')' ] = terminal_symbol_t::TS_CLOSING_SCOPE;
+    table[ (unsigned char) ' ' ] = terminal_symbol_t::TS_WS;
+    table[ 9 ]                   = terminal_symbol_t::TS_TAB;
+    table[ (unsigned char) '0' ] = terminal_symbol_t::TS_ZERO;
+    for( char d = '1'; d <= '9'; ++d )
+        table[ (unsigned char) d ] = terminal_symbol_t::TS_NON_ZERO_DIGIT;
+    for( char l = 'a'; l <= 'z'; ++l )
+        table[ (unsigned char) l ] = terminal_symbol_t::TS_LETTER;
+    for( char l = 'A'; l <= 'Z'; ++l )
+        table[ (unsigned char) l ] = terminal_symbol_t::TS_LETTER;
+    table[ (unsigned char) '_' ] = terminal_symbol_t::TS_LETTER;
+    table[ 0 ]                   = terminal_symbol_t::TS_EOS; // end of string: the $ terminal symbol
+
+    return table;
+}
+
+/// Tabela de classificação dos bytes (inicializada em tempo de compilação).
+const std::array< Parser::terminal_symbol_t, 256 > Parser::char_class = Parser::make_char_class();
 
 /** @brief Converte de caractere para código do símbolo terminal.
             @param ch Caractere.
             @return Código do simbolo terminal. */
 Parser::terminal_symbol_t  Parser::lexer( char c_ ) const
 {
-    switch( c_ )
+    return char_class[ (unsigned char) c_ ];
+}
+
+
+/** @brief Converte um simbolo terminal para o operador correspondente.
+    @param s_ Simbolo do terminal.
+    @return Código do operador (operator_t::NONE se não for operador). */
+Token::operator_t Parser::operator_of( terminal_symbol_t s_ )
+{
+    switch( s_ )
     {
-        case '+':  return terminal_symbol_t::TS_PLUS;
-        case '-':  return terminal_symbol_t::TS_MINUS;
-        case '*':  return terminal_symbol_t::TS_MULTIPLICATION;
-        case '/':  return terminal_symbol_t::TS_DIVISION;
-        case '%':  return terminal_symbol_t::TS_REST;
-        case '^':  return terminal_symbol_t::TS_POTENTIATION;
-        case ' ':  return terminal_symbol_t::TS_WS;
-        case   9:  return terminal_symbol_t::TS_TAB;
-        case '0':  return terminal_symbol_t::TS_ZERO;
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':  return terminal_symbol_t::TS_NON_ZERO_DIGIT;
-        case '\0': return terminal_symbol_t::TS_EOS; // end of string: the $ terminal symbol
+        case terminal_symbol_t::TS_PLUS           : return Token::operator_t::PLUS;
+        case terminal_symbol_t::TS_MINUS          : return Token::operator_t::MINUS;
+        case terminal_symbol_t::TS_MULTIPLICATION : return Token::operator_t::MULTIPLICATION;
+        case terminal_symbol_t::TS_DIVISION       : return Token::operator_t::DIVISION;
+        case terminal_symbol_t::TS_REST           : return Token::operator_t::REST;
+        case terminal_symbol_t::TS_POTENTIATION   : return Token::operator_t::POTENTIATION;
+        default                                   : return Token::operator_t::NONE;
     }
-    return terminal_symbol_t::TS_INVALID;
 }
 
-
 /** @brief Converte um simbolo terminal para a string correspondente.
     @param ch Caractere.
     @return Código do simbolo terminal. */
@@ -56,17 +193,33 @@ std::string Parser::token_str( terminal_symbol_t s_ ) const
         case terminal_symbol_t::TS_DIVISION         : return "/";
         case terminal_symbol_t::TS_REST             : return "%";
         case terminal_symbol_t::TS_POTENTIATION     : return "^";
+        case terminal_symbol_t::TS_OPENING_SCOPE    : return "(";
+        case terminal_symbol_t::TS_CLOSING_SCOPE    : return ")";
         case terminal_symbol_t::TS_WS               : return " ";
         case terminal_symbol_t::TS_ZERO             : return "0";
         default                                     : return "X";
     }
 }
 
+/** @brief Coluna do último caractere consumido.
+    @return Coluna (a partir de zero). */
+Token::col_type Parser::prev_col( void ) const
+{
+    return static_cast< Token::col_type >( it_curr_symb - expr.begin() ) - 1;
+}
+
 /** @brief Iterador para avançar para próximo char na expressão. */
 void Parser::next_symbol( void )
 {
     // Get a valid symbol for processing
     std::advance( it_curr_symb, 1 );
+    classify();
+}
+
+/** @brief Classifica o caractere atual (uma única vez por caractere). */
+void Parser::classify( void )
+{
+    curr_symb = end_input() ? terminal_symbol_t::TS_EOS : lexer( *it_curr_symb );
 }
 
 /** @brief Verifica se o símbolo atual é igual ao símbolo do terminal solicitado.
@@ -75,9 +228,8 @@ void Parser::next_symbol( void )
 bool Parser::peek( terminal_symbol_t c_ ) const
 {
     // Verificar se o código fornecido no argumento corresponde
-    // ao caractere na "ponta da agulha" (apontado pelo iterador).
-    return ( not end_input() and
-             lexer( *it_curr_symb ) == c_ );
+    // ao caractere na "ponta da agulha" (já classificado).
+    return curr_symb == c_;
 }
 
 /** @brief Tenta aceitar o símbolo solicitado.
@@ -111,15 +263,17 @@ bool Parser::expect( terminal_symbol_t c_ )
 /** @brief Ignora qualquer WS/Tab e para no próximo caractere. */
 void Parser::skip_ws( void )
 {
-    // Simplemente salta todos os caracteres em branco.
-    // Lembrar de verificar se a entrada não acabou, para evitar de
-    // acessar um iterador inválido.
-    while ( not end_input() and
-            ( lexer( *it_curr_symb ) == Parser::terminal_symbol_t::TS_WS  or
-              lexer( *it_curr_symb ) == Parser::terminal_symbol_t::TS_TAB ) )
-    {
-        next_symbol();
-    }
+    if ( curr_symb != terminal_symbol_t::TS_WS and curr_symb != terminal_symbol_t::TS_TAB )
+        return;
+
+    // Laço direto sobre os bytes: só o primeiro caractere que não é
+    // branco passa pela classificação.
+    auto end = expr.end();
+    do {
+        ++it_curr_symb;
+    } while ( it_curr_symb != end and ( *it_curr_symb == ' ' or *it_curr_symb == 9 ) );
+
+    classify();
 }
 
 /** @brief Verifica se chegamos ao final da sequência de expressão.
@@ -131,23 +285,67 @@ bool Parser::end_input( void ) const
     return it_curr_symb == expr.end();
 }
 
-/** @brief Converte um string em um integer.
-    @param ch Caractere .
-    @return Caractere no tipo inteiro. */ 
-Parser::input_int_type str_to_int( std::string input_str_ )
+/** @brief Emite um operador binário.
+    @param tk_ Token do operador. */
+void Parser::emit_operator( const Token & tk_ )
+{
+    if ( not postfix_on ){
+        tokens_out->push_back( tk_ );
+        return;
+    }
+
+    // Saem os operadores pendentes que ligam mais forte que o novo.
+    // Um '(' pendente tem precedência 0 e segura os de fora.
+    auto p = Token::precedence( tk_.op );
+    bool right = Token::right_associative( tk_.op );
+    while ( not pending.empty() )
+    {
+        auto q = Token::precedence( pending.back().op );
+        if ( q < p or ( q == p and right ) )
+            break;
+        tokens_out->push_back( pending.back() );
+        pending.pop_back();
+    }
+
+    pending.push_back( tk_ );
+}
+
+/** @brief Emite um '('.
+    @param col_ Coluna do '('. */
+void Parser::open_scope( Token::col_type col_ )
 {
-    // Creating input stream.
-    std::istringstream iss( input_str_ );
+    if ( postfix_on )
+        pending.push_back( Token( Token::token_t::OPENING_SCOPE, col_ ) );
+    else
+        tokens_out->push_back( Token( Token::token_t::OPENING_SCOPE, col_ ) );
+}
 
-    // Resulting value.
-    Parser::input_int_type value;
-    iss >> value; // Ignore trailling white space.
+/** @brief Emite um ')'.
+    @param col_ Coluna do ')'. */
+void Parser::close_scope( Token::col_type col_ )
+{
+    if ( not postfix_on ){
+        tokens_out->push_back( Token( Token::token_t::CLOSING_SCOPE, col_ ) );
+        return;
+    }
 
-    // Check for error during convertion.
-    if ( iss.fail() )
-        //throw std::runtime_error( "str_to_int(): Erro, illegal integer format." );
+    // Saem os operadores do escopo; o '(' correspondente é descartado.
+    while ( pending.back().type != Token::token_t::OPENING_SCOPE )
+    {
+        tokens_out->push_back( pending.back() );
+        pending.pop_back();
+    }
+    pending.pop_back();
+}
 
-    return value;
+/** @brief Emite os operadores pendentes no fim da expressão. */
+void Parser::flush_operators( void )
+{
+    while ( not pending.empty() )
+    {
+        tokens_out->push_back( pending.back() );
+        pending.pop_back();
+    }
 }
 
 //=== NTS methods.
@@ -155,10 +353,23 @@ Parser::input_int_type str_to_int( std::string input_str_ )
 /*! Processando uma expressão.
  *
  * Produção:
- * <expr> := <term>,{ ("+"|"-"),<term> }
+ * <expr> := <term>,{ ("+"|"-"|"*"|"/"|"%"|"^"),<term> }
+ * <term> := "(",<expr>,")" | <integer> | <identifier>
  *
  * De acordo com a gramática (acima), uma expressão pode ser apenas um
- * termo isolado ou seguido de um ou mais termos com um + ou - entre eles.
+ * termo isolado ou seguido de um ou mais termos com um operador entre eles.
+ *
+ * Sub-expressões entre parênteses não geram chamadas recursivas: cada
+ * '(' é empilhado em 'scopes' e a sub-expressão continua sendo tratada
+ * por este mesmo laço, até o ')' correspondente desempilhá-lo. Assim,
+ * expressões com milhares de níveis de aninhamento não estouram a
+ * pilha de chamadas e são processadas em tempo linear.
+ *
+ * Com emit_postfix( true ), os tokens já saem no formato postfix: é o
+ * shunting-yard (o mesmo de BaresManager::infix_to_postfix) feito
+ * durante o próprio parsing, com a pilha de operadores em 'pending'.
+ * Um operador que chega desempilha os de precedência maior, ou igual
+ * se ele associa à esquerda ("^" associa à direita).
  *
  */
 
@@ -166,55 +377,54 @@ Parser::input_int_type str_to_int( std::string input_str_ )
     @return Resultado do processamento. */ 
 Parser::ParserResult Parser::expression()
 {
+    scopes.clear();
+    pending.clear();
+
     skip_ws(); // Salta todos os espaços em branco.
 
     // (1) Vamos validar um termo.
     auto result = term();
 
-    // Usamos um 'enquanto' pois podem vir 1 ou mais termos ligados por +/-.
-    while ( result.type == ParserResult::PARSER_OK and not end_input() )
+    // Usamos um 'enquanto' pois podem vir 1 ou mais termos ligados por operadores.
+    while ( result.type == ParserResult::PARSER_OK )
     {
         // ============================================================
         // Se chegamos aqui significa que um termo **válido** foi
         // consumido da entrada (expressão), ou através do método
         // term() fora do laço (na 1ª vez) ou através do método
         // term() invocado no final do laço (para as demais vezes).
-        // Portanto, devemos verificar se existem novos termos
-        // na entrada (expressão), precedidos por +/-.
         // ============================================================
 
-        // (2) Pode vir um '+', ou seja, "esperamos" um '+'...
-        if ( expect( terminal_symbol_t::TS_PLUS ) )
-        {
-            // Ok, recebemos:
-            token_list.push_back( Token("+", Token::token_t::OPERATOR) );
-        }
-        // (3) ... mas pode vir um '-', ou seja, também "esperamos" um '-'.
-        else if ( expect( terminal_symbol_t::TS_MINUS ) ) // ou um '-'
-        {
-            // Ok, recebemos:
-            token_list.push_back( Token("-", Token::token_t::OPERATOR) );
-        } else if ( expect( terminal_symbol_t::TS_MULTIPLICATION ) ) // ou um '*'
-        {
-            // Ok, recebemos:
-            token_list.push_back( Token("*", Token::token_t::OPERATOR) );
-        } else if ( expect( terminal_symbol_t::TS_DIVISION ) ) // ou um '/'
-        {
-            // Ok, recebemos:
-            token_list.push_back( Token("/", Token::token_t::OPERATOR) );
-        } else if ( expect( terminal_symbol_t::TS_REST ) ) // ou um '%'
-        {
-            // Ok, recebemos:
-            token_list.push_back( Token("%", Token::token_t::OPERATOR) );
-        } else if ( expect( terminal_symbol_t::TS_POTENTIATION ) ) // ou um '^'
-        {
-            // Ok, recebemos:
-            token_list.push_back( Token("^", Token::token_t::OPERATOR) );
-        } else // ... mas se vier outra coisa, é um erro de sintaxe!
+        // (2) Depois de um termo podem vir ')' fechando escopos abertos.
+        skip_ws();
+        while ( peek( terminal_symbol_t::TS_CLOSING_SCOPE ) )
         {
-            return result;
+            // ')' sem '(' correspondente: parse() acusa o símbolo extra.
+            if ( scopes.empty() )
+                return result;
+
+            next_symbol();
+            scopes.pop_back();
+            close_scope( prev_col() );
+            skip_ws();
         }
 
+        if ( end_input() )
+            break;
+
+        // Portanto, devemos verificar se existem novos termos
+        // na entrada (expressão), precedidos por um operador.
+
+        // (3) Pode vir um operador: o símbolo atual já está classificado,
+        // então basta consultar a tabela de operadores.
+        auto op = operator_of( curr_symb );
+        if ( op == Token::operator_t::NONE ) // ... mas se vier outra coisa, a expressão acabou aqui.
+            break;
+
+        // Ok, recebemos:
+        next_symbol();
+        emit_operator( Token( op, prev_col() ) );
+
         // (4) Se chegamos aqui é porque recebemos com sucesso um
         // operador. Então agora TEM QUE VIR UM TERMO!.
         // Se não vier um termo, então temos um erro de sintaxe.
@@ -224,15 +434,26 @@ Parser::ParserResult Parser::expression()
         {
             // Se o termo não foi encontrado, atualizamos a mensagem
             // de erro (ParserResult) recebida com um tipo mais
-            // explicativo para o cliente.
-            result.type = ParserResult::MISSING_TERM;
+            // explicativo para o cliente. Um inteiro fora da faixa
+            // é um termo presente, e mantém o próprio erro.
+            if ( result.type != ParserResult::INTEGER_OUT_OF_RANGE )
+                result.type = ParserResult::MISSING_TERM;
             return result;
         }
 
+    }
 
-
+    // Algum '(' ficou sem o ')' correspondente.
+    if ( result.type == ParserResult::PARSER_OK and not scopes.empty() )
+    {
+        return ParserResult( ParserResult::MISSING_CLOSING_PARENTHESIS,
+                std::distance( expr.begin(), it_curr_symb ) );
     }
 
+    // Os operadores que ainda esperam o operando da direita saem agora.
+    if ( result.type == ParserResult::PARSER_OK )
+        flush_operators();
+
     return result;
 }
 
@@ -241,14 +462,24 @@ Parser::ParserResult Parser::expression()
 Parser::ParserResult Parser::term(){
     skip_ws();
 
-    auto begin = it_curr_symb;
-    auto result =  integer();
+    // Cada '(' abre um escopo; a sub-expressão segue no laço de expression().
+    while( accept( terminal_symbol_t::TS_OPENING_SCOPE ) ){
+        scopes.push_back( prev_col() );
+        open_scope( prev_col() );
+        skip_ws();
+    }
 
-    std::string val;
-    val.insert( val.begin(), begin, it_curr_symb );
+    // Uma variável, quando permitidas, no lugar do inteiro.
+    if ( variables_on and peek( terminal_symbol_t::TS_LETTER ) )
+        return identifier();
 
-    if( not val.empty() ){ // se não for vazio
-        token_list.push_back( Token( val, Token::token_t::OPERAND) ); // add token
+    auto begin = it_curr_symb;
+    input_int_type value( 0 );
+    auto result =  integer( value );
+
+    // O token já guarda o valor convertido, junto com a coluna de origem.
+    if( result.type == ParserResult::PARSER_OK and begin != it_curr_symb ){
+        tokens_out->push_back( Token( value, std::distance( expr.begin(), begin ) ) ); // add token
     }
 
     return result;
@@ -256,60 +487,119 @@ Parser::ParserResult Parser::term(){
 }
 
 /** @brief Processa um inteiro.
+    O valor precisa caber em required_int_type; caso contrário o
+    resultado é INTEGER_OUT_OF_RANGE, apontando para o início do inteiro.
+    @param value_ Recebe o valor do inteiro.
     @return Resultado do processamento. */ 
-Parser::ParserResult Parser::integer()
+Parser::ParserResult Parser::integer( input_int_type & value_ )
 {
     // Será que é um zero?
-    if( lexer( *it_curr_symb ) == terminal_symbol_t::TS_ZERO ){
+    if( accept( terminal_symbol_t::TS_ZERO ) ){
+        value_ = 0;
         return ParserResult( ParserResult::PARSER_OK );
     }
 
+    auto begin = std::distance( expr.begin(), it_curr_symb );
+
     // Tratar o '-' unário
-    while( accept( terminal_symbol_t::TS_MINUS ) ){ }
+    int minus( 0 );
+    while( accept( terminal_symbol_t::TS_MINUS ) ){ ++minus; }
 
-    return natural_number();
+    auto result = natural_number( value_ );
+    if ( result.type == ParserResult::INTEGER_OUT_OF_RANGE )
+        result.at_col = begin;
+    if ( result.type != ParserResult::PARSER_OK )
+        return result;
 
-}
+    // Cada par de '-' se anula.
+    if ( minus % 2 )
+        value_ = -value_;
 
-/** @brief Processa um número natural.
-    @return Resultado do processamento. */ 
-Parser::ParserResult Parser::natural_number()
-{
-    if( digit_excl_zero() ){
-        while( digit() ); /* Empty */
+    // Faixa exigida para as constantes da expressão.
+    if ( value_ < std::numeric_limits< required_int_type >::min() or
+         value_ > std::numeric_limits< required_int_type >::max() )
+        return ParserResult( ParserResult::INTEGER_OUT_OF_RANGE, begin );
 
-        return ParserResult( ParserResult::PARSER_OK );
-    }
+    return result;
 
-    return ParserResult( ParserResult::ILL_FORMED_INTEGER, std::distance( expr.begin(), it_curr_symb ) );
 }
 
-/** @brief Verifica se número é 1...9.
-    @return 1 se for 0 otherwise. */
-bool Parser::digit_excl_zero()
+/** @brief Processa um identificador, que vira um token VARIABLE.
+    @return Resultado do processamento. */
+Parser::ParserResult Parser::identifier()
 {
-    return accept( terminal_symbol_t::TS_NON_ZERO_DIGIT );
+    auto begin = it_curr_symb;
+    while ( peek( terminal_symbol_t::TS_LETTER ) or peek( terminal_symbol_t::TS_ZERO ) or
+            peek( terminal_symbol_t::TS_NON_ZERO_DIGIT ) )
+        next_symbol();
+
+    auto name = expr.substr( begin - expr.begin(), it_curr_symb - begin );
+
+    // Cada nome distinto ganha um índice, na ordem em que aparece.
+    size_t slot = 0;
+    while ( slot < variables.size() and variables[slot] != name )
+        ++slot;
+    if ( slot == variables.size() )
+        variables.emplace_back( name );
+
+    tokens_out->push_back( Token( Token::token_t::VARIABLE, std::distance( expr.begin(), begin ), slot ) );
+
+    return ParserResult( ParserResult::PARSER_OK );
 }
 
-/** @brief Verifica se número é 0...9.
-    @return 1 se for 0 otherwise. */
-bool Parser::digit()
+/** @brief Processa um número natural.
+    @param value_ Recebe o valor do número.
+    @return Resultado do processamento. */ 
+Parser::ParserResult Parser::natural_number( input_int_type & value_ )
 {
-    return (accept( terminal_symbol_t::TS_ZERO ) or
-            accept( terminal_symbol_t::TS_NON_ZERO_DIGIT ));
+    if( not peek( terminal_symbol_t::TS_NON_ZERO_DIGIT ) ){
+        return ParserResult( ParserResult::ILL_FORMED_INTEGER, std::distance( expr.begin(), it_curr_symb ) );
+    }
+
+    // Varre e converte a sequência de dígitos numa única passada (SWAR).
+    std::uint64_t magnitude;
+    bool overflow;
+    auto begin = it_curr_symb;
+    it_curr_symb = scan_digits( it_curr_symb, expr.end(), magnitude, overflow );
+    classify();
+
+    // O valor precisa caber em input_int_type antes de qualquer outra checagem.
+    if ( overflow or magnitude > static_cast< std::uint64_t >( std::numeric_limits< input_int_type >::max() ) )
+        return ParserResult( ParserResult::INTEGER_OUT_OF_RANGE, std::distance( expr.begin(), begin ) );
+
+    value_ = static_cast< input_int_type >( magnitude );
+
+    return ParserResult( ParserResult::PARSER_OK );
 }
 
 
 /** @brief Realiza o parsing
+    A expressão não é copiada: o parser percorre a própria memória
+    apontada por e_, que precisa continuar válida durante a chamada.
+    Os tokens ficam no buffer interno, cuja capacidade é mantida
+    entre as chamadas.
+    @param e_ Expressão.
+    @return Resultado. */
+Parser::ParserResult
+Parser::parse( std::string_view e_ )
+{
+    return parse( e_, token_list );
+}
+
+/** @brief Realiza o parsing, gravando os tokens direto em out_.
     @param e_ Expressão.
+    @param out_ Buffer do chamador que recebe os tokens.
     @return Resultado. */
 Parser::ParserResult
-Parser::parse( std::string e_ )
+Parser::parse( std::string_view e_, TokenList & out_ )
 {
     // We reset the parsing process each new expression.
-    expr = e_;  // The expression in a string.
+    expr = e_;  // A view over the caller's expression (no copy).
     it_curr_symb = expr.begin(); // Iterator to the 1st character in the expression.
-    token_list.clear(); // Clear the list of tokens.
+    classify();
+    tokens_out = &out_; // Os tokens vão direto para o buffer escolhido.
+    tokens_out->clear(); // Clear the list of tokens.
+    variables.clear();  // Idem para os nomes das variáveis.
 
     // Default result.
     ParserResult result( ParserResult::PARSER_OK );
@@ -336,13 +626,15 @@ Parser::parse( std::string e_ )
     return result;
 }
 
-
-/** @brief Recupera tokens.
+/** @brief Entrega os tokens da última chamada de parse( e_ ) ao
+    chamador, por move.
     @return Lista de tokens. */
-std::vector< Token > Parser::get_tokens( void ) const {
-    return token_list;
+TokenList Parser::take_tokens( void )
+{
+    TokenList out( std::move( token_list ) );
+    token_list.clear(); // Um vetor "movido" fica em estado válido, mas não especificado.
+    return out;
 }
 
 
-
 //==========================[ End of parse.cpp ]==========================//
\ No newline at end of file
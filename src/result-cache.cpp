@@ -0,0 +1,164 @@
+/**
+ * @file    result-cache.cpp
+ * @brief   Código fonte com o cache de resultados do bares.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <iterator> // std::prev
+#include <algorithm> // std::min
+
+#include "result-cache.h" // classe ResultCache.
+
+
+/**
+ * @brief Verifica se o caractere é um espaço para o Parser (WS ou Tab).
+ * @param c Caractere.
+ * @return 1 se é espaço 0 otherwise.
+ */
+static inline bool is_ws( char c ){
+    return c == ' ' or c == '\t';
+}
+
+/** @brief Cria um cache vazio.
+    @param capacidade_ Número máximo de expressões guardadas. */
+ResultCache::ResultCache( size_t capacidade_ )
+    : capacidade( capacidade_ )
+{
+    // Reserva só o começo: com um --cache grande, o índice cresce conforme
+    // as expressões chegam, em vez de alocar tudo antes da primeira linha.
+    indice.reserve( std::min< size_t >( capacidade, 4096 ) );
+}
+
+/**
+ * @brief Verifica se a posição i da expressão gera um caractere na chave:
+ *        todo símbolo que não é espaço e o primeiro espaço de cada
+ *        sequência (os espaços antes do primeiro símbolo são descartados).
+ * @param e Expressão original.
+ * @param i Posição.
+ * @return 1 se gera um caractere 0 otherwise.
+ */
+static inline bool emits( std::string_view e, size_t i ){
+    return not is_ws( e[i] ) or ( i > 0 and not is_ws( e[i-1] ) );
+}
+
+/** @brief Normaliza a expressão em 'chave'.
+    @param expr_ Expressão original. */
+void ResultCache::normalize( std::string_view expr_ ){
+
+    // O buffer é reaproveitado entre as chamadas: depois das primeiras
+    // linhas, montar a chave não aloca memória.
+    chave.clear();
+
+    for( size_t i = 0; i < expr_.size(); ++i )
+        if ( emits( expr_, i ) )
+            chave += is_ws( expr_[i] ) ? ' ' : expr_[i];
+}
+
+/** @brief Converte uma coluna da chave para a coluna na expressão original.
+    O Parser aponta erros para um símbolo, para o primeiro espaço de uma
+    sequência ou para o fim da linha, e todos têm correspondência exata.
+    @param expr_ Expressão original.
+    @param col_ Coluna na chave normalizada.
+    @return Coluna correspondente em expr_. */
+size_t ResultCache::original_col( std::string_view expr_, size_t col_ ){
+
+    size_t n = 0; // Caracteres da chave já percorridos.
+    for( size_t i = 0; i < expr_.size(); ++i )
+        if ( emits( expr_, i ) and n++ == col_ )
+            return i;
+
+    return expr_.size();
+}
+
+/** @brief Converte uma coluna da expressão original para a coluna na chave.
+    @param expr_ Expressão original.
+    @param col_ Coluna em expr_.
+    @return Coluna correspondente na chave normalizada. */
+size_t ResultCache::normalized_col( std::string_view expr_, size_t col_ ){
+
+    size_t n = 0;
+    for( size_t i = 0; i < col_ and i < expr_.size(); ++i )
+        if ( emits( expr_, i ) )
+            ++n;
+
+    return n;
+}
+
+/** @brief Procura a expressão no cache.
+    @param expr_ Expressão, como aparece na entrada.
+    @param rec_ Registro que recebe o resultado.
+    @param tokens_ Recebe, num acerto, o número de tokens da expressão.
+    @return true se a expressão estava no cache. */
+bool ResultCache::lookup( std::string_view expr_, Record & rec_, size_t * tokens_ ){
+
+    normalize( expr_ );
+
+    auto it = indice.find( chave );
+    if ( it == indice.end() ){
+        ++n_misses;
+        return false;
+    }
+
+    ++n_hits;
+
+    // Passa a ser a entrada usada mais recentemente.
+    ordem.splice( ordem.begin(), ordem, it->second );
+
+    const auto & e = *it->second;
+    rec_.status = e.status;
+    rec_.result = e.result;
+    if ( e.status == Record::SYNTAX_ERROR )
+        rec_.result.at_col = original_col( expr_, e.result.at_col );
+    rec_.value = e.value;
+    rec_.runtime_error = e.runtime_error;
+    if ( tokens_ )
+        *tokens_ = e.tokens;
+
+    // Nada foi tokenizado para esta linha.
+    rec_.tokens.clear();
+    rec_.postfix.clear();
+    rec_.program.code.clear();
+
+    return true;
+}
+
+/** @brief Guarda o resultado de uma expressão já processada.
+    @param expr_ Expressão, como aparece na entrada.
+    @param rec_ Registro com o resultado final da linha. */
+void ResultCache::store( std::string_view expr_, const Record & rec_ ){
+
+    if ( capacidade == 0 )
+        return;
+
+    // Cheio: os nós (da lista e do índice) da entrada mais antiga são
+    // reaproveitados para a nova, sem passar pelo alocador.
+    decltype( indice )::node_type no;
+    if ( ordem.size() == capacidade ){
+        no = indice.extract( ordem.back().key );
+        ordem.splice( ordem.begin(), ordem, std::prev( ordem.end() ) );
+        ++n_evictions;
+    }
+    else {
+        ordem.emplace_front();
+    }
+
+    auto & e = ordem.front();
+    e.key = chave; // 'chave' ainda é a do lookup() desta expressão.
+    e.status = rec_.status;
+    e.result = rec_.result;
+    if ( rec_.status == Record::SYNTAX_ERROR )
+        e.result.at_col = normalized_col( expr_, rec_.result.at_col );
+    e.value = rec_.value;
+    e.runtime_error = rec_.runtime_error;
+    e.tokens = rec_.tokens.empty() ? rec_.postfix.size() : rec_.tokens.size();
+
+    if ( no ){
+        no.key() = e.key;
+        no.mapped() = ordem.begin();
+        indice.insert( std::move( no ) );
+    }
+    else
+        indice.emplace( e.key, ordem.begin() );
+}
@@ -0,0 +1,294 @@
+/**
+ * @file    server.cpp
+ * @brief   Código fonte do modo servidor: laço de eventos epoll sobre
+            um socket Unix local.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <cstring>       // strlen, memcpy
+#include <cerrno>        // errno
+#include <csignal>       // sigset_t, SIGINT, SIGTERM
+
+#include <unistd.h>      // read, close, unlink
+#include <sys/socket.h>  // socket, bind, listen, accept4, send
+#include <sys/un.h>      // sockaddr_un
+#include <sys/stat.h>    // stat
+#include <sys/epoll.h>   // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/signalfd.h> // signalfd
+
+#include "server.h" // classe Server.
+
+
+/// Acrescenta um caractere na string de destino.
+Server::Acumulador::int_type Server::Acumulador::overflow( int_type ch_ ){
+    if ( not traits_type::eq_int_type( ch_, traits_type::eof() ) )
+        destino->push_back( traits_type::to_char_type( ch_ ) );
+    return traits_type::not_eof( ch_ );
+}
+
+/// Acrescenta n_ caracteres na string de destino.
+std::streamsize Server::Acumulador::xsputn( const char * s_, std::streamsize n_ ){
+    destino->append( s_, n_ );
+    return n_;
+}
+
+/** @brief Cria o servidor.
+    @param manager_ Gerenciador que avalia as expressões. */
+Server::Server( BaresManager & manager_ )
+    : manager( manager_ )
+    , leitura( TAMANHO_LEITURA )
+    , respostas( &acumulador )
+{ /* empty */ }
+
+/// Fecha os clientes e o socket, que é removido do sistema de arquivos.
+Server::~Server(){
+    for( auto & c : conexoes )
+        if ( c )
+            ::close( c->fd );
+    if ( fd_sinais >= 0 ) ::close( fd_sinais );
+    if ( fd_epoll >= 0 )  ::close( fd_epoll );
+    if ( fd_escuta >= 0 ){
+        ::close( fd_escuta );
+        ::unlink( caminho.c_str() );
+    }
+}
+
+/** @brief Cria o socket e começa a escutar.
+    @param caminho_ Caminho do socket.
+    @return 1 se o socket foi criado; 0 otherwise. */
+int Server::open( const char * caminho_ ){
+
+    sockaddr_un addr{};
+    if ( std::strlen( caminho_ ) >= sizeof addr.sun_path )
+        return 0;
+    addr.sun_family = AF_UNIX;
+    std::memcpy( addr.sun_path, caminho_, std::strlen( caminho_ ) );
+
+    // Um socket que sobrou de uma execução anterior é substituído;
+    // qualquer outro tipo de arquivo no caminho é mantido (e o bind falha).
+    struct stat st;
+    if ( ::stat( caminho_, &st ) == 0 and S_ISSOCK( st.st_mode ) )
+        ::unlink( caminho_ );
+
+    fd_escuta = ::socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( fd_escuta < 0 )
+        return 0;
+    if ( ::bind( fd_escuta, reinterpret_cast< sockaddr * >( &addr ), sizeof addr ) < 0 ){
+        ::close( fd_escuta );
+        fd_escuta = -1;
+        return 0;
+    }
+    caminho = caminho_;
+    if ( ::listen( fd_escuta, SOMAXCONN ) < 0 )
+        return 0;
+
+    fd_epoll = ::epoll_create1( EPOLL_CLOEXEC );
+    if ( fd_epoll < 0 )
+        return 0;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd_escuta;
+    if ( ::epoll_ctl( fd_epoll, EPOLL_CTL_ADD, fd_escuta, &ev ) < 0 )
+        return 0;
+
+    return 1;
+}
+
+/** @brief Atende os clientes até receber SIGINT ou SIGTERM.
+    @return 1 se o servidor parou normalmente; 0 otherwise. */
+int Server::run( void ){
+
+    if ( fd_epoll < 0 )
+        return 0;
+
+    // Os sinais de parada chegam como eventos do próprio epoll.
+    sigset_t sinais, anteriores;
+    sigemptyset( &sinais );
+    sigaddset( &sinais, SIGINT );
+    sigaddset( &sinais, SIGTERM );
+    if ( ::sigprocmask( SIG_BLOCK, &sinais, &anteriores ) < 0 )
+        return 0;
+    fd_sinais = ::signalfd( -1, &sinais, SFD_NONBLOCK | SFD_CLOEXEC );
+    if ( fd_sinais < 0 )
+        return 0;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd_sinais;
+    if ( ::epoll_ctl( fd_epoll, EPOLL_CTL_ADD, fd_sinais, &ev ) < 0 )
+        return 0;
+
+    epoll_event eventos[64];
+    bool parar = false;
+    while ( not parar ){
+
+        int n = ::epoll_wait( fd_epoll, eventos, 64, -1 );
+        if ( n < 0 ){
+            if ( errno == EINTR )
+                continue;
+            return 0;
+        }
+
+        for( int i = 0; i < n; ++i ){
+
+            int fd = eventos[i].data.fd;
+            auto ocorridos = eventos[i].events;
+
+            if ( fd == fd_sinais ){
+                // Consome o sinal: ele não pode estar pendente quando a
+                // máscara anterior for restaurada.
+                signalfd_siginfo info;
+                while ( ::read( fd_sinais, &info, sizeof info ) == sizeof info )
+                    /* empty */;
+                parar = true;
+                continue;
+            }
+            if ( fd == fd_escuta ){
+                aceitar();
+                continue;
+            }
+
+            // O cliente pode ter sido fechado por um evento anterior deste lote.
+            if ( static_cast< size_t >( fd ) >= conexoes.size() or not conexoes[fd] )
+                continue;
+            auto & c = *conexoes[fd];
+
+            bool ok = true;
+            if ( ocorridos & EPOLLOUT )
+                ok = enviar( c );
+            if ( ok and ( ocorridos & EPOLLIN ) )
+                ok = ler( c );
+            else if ( ok and ( ocorridos & ( EPOLLERR | EPOLLHUP ) ) and c.saida.empty() )
+                ok = false;
+
+            // Cliente que já fechou a escrita sai quando não há mais o que enviar.
+            if ( not ok or ( c.fechando and c.saida.empty() ) )
+                fechar( c );
+            else
+                atualizarEventos( c );
+        }
+    }
+
+    ::sigprocmask( SIG_SETMASK, &anteriores, nullptr );
+    return 1;
+}
+
+/** @brief Aceita todas as conexões pendentes. */
+void Server::aceitar( void ){
+
+    for( ;; ){
+        int fd = ::accept4( fd_escuta, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if ( fd < 0 )
+            return; // EAGAIN: não há mais conexões; outros erros: tenta no próximo evento.
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if ( ::epoll_ctl( fd_epoll, EPOLL_CTL_ADD, fd, &ev ) < 0 ){
+            ::close( fd );
+            continue;
+        }
+
+        if ( static_cast< size_t >( fd ) >= conexoes.size() )
+            conexoes.resize( fd + 1 );
+        conexoes[fd].reset( new Conexao() );
+        conexoes[fd]->fd = fd;
+        conexoes[fd]->eventos = EPOLLIN;
+    }
+}
+
+/** @brief Lê o que o cliente enviou e avalia as linhas completas.
+    Uma única leitura por evento: o epoll avisa de novo se ainda houver
+    dados, e os outros clientes são atendidos no meio tempo.
+    @param c Cliente.
+    @return false se a conexão caiu. */
+bool Server::ler( Conexao & c ){
+
+    ssize_t n = ::read( c.fd, leitura.data(), leitura.size() );
+    if ( n < 0 )
+        return errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR;
+
+    // Os bytes anteriores não têm '\n': a busca começa nos novos.
+    size_t busca = c.entrada.size();
+    c.entrada.append( leitura.data(), n );
+
+    // Cada linha completa vira uma linha de resposta, na mesma ordem.
+    acumulador.destino = &c.saida;
+    std::string_view recebido( c.entrada );
+    size_t inicio = 0, fim;
+    while ( ( fim = recebido.find( '\n', busca ) ) != std::string_view::npos ){
+        manager.responder( recebido.substr( inicio, fim - inicio ), respostas );
+        inicio = busca = fim + 1;
+    }
+    c.entrada.erase( 0, inicio );
+
+    if ( n == 0 ){
+        // O cliente fechou a escrita: o que sobrou também é uma expressão.
+        if ( not c.entrada.empty() ){
+            manager.responder( c.entrada, respostas );
+            c.entrada.clear();
+        }
+        c.fechando = true;
+    }
+    else if ( c.entrada.size() > LIMITE_LINHA )
+        return false; // linha grande demais, sem '\n'
+
+    return enviar( c );
+}
+
+/** @brief Envia as respostas pendentes do cliente.
+    @param c Cliente.
+    @return false se a conexão caiu. */
+bool Server::enviar( Conexao & c ){
+
+    while ( c.enviado < c.saida.size() ){
+        ssize_t n = ::send( c.fd, c.saida.data() + c.enviado, c.saida.size() - c.enviado, MSG_NOSIGNAL );
+        if ( n >= 0 )
+            c.enviado += n;
+        else if ( errno == EINTR )
+            continue;
+        else if ( errno == EAGAIN or errno == EWOULDBLOCK )
+            return true; // o resto sai quando o socket aceitar (EPOLLOUT)
+        else
+            return false;
+    }
+
+    // Tudo enviado: a capacidade da string fica para as próximas respostas.
+    c.saida.clear();
+    c.enviado = 0;
+    return true;
+}
+
+/** @brief Ajusta os eventos do cliente no epoll.
+    @param c Cliente. */
+void Server::atualizarEventos( Conexao & c ){
+
+    size_t pendente = c.saida.size() - c.enviado;
+
+    unsigned eventos = 0;
+    if ( not c.fechando and pendente < LIMITE_SAIDA )
+        eventos |= EPOLLIN;
+    if ( pendente > 0 )
+        eventos |= EPOLLOUT;
+
+    if ( eventos == c.eventos )
+        return;
+
+    epoll_event ev{};
+    ev.events = eventos;
+    ev.data.fd = c.fd;
+    ::epoll_ctl( fd_epoll, EPOLL_CTL_MOD, c.fd, &ev );
+    c.eventos = eventos;
+}
+
+/** @brief Fecha a conexão e descarta o estado do cliente.
+    @param c Cliente. */
+void Server::fechar( Conexao & c ){
+    int fd = c.fd;
+    ::epoll_ctl( fd_epoll, EPOLL_CTL_DEL, fd, nullptr );
+    ::close( fd );
+    conexoes[fd].reset();
+}
@@ -0,0 +1,163 @@
+/**
+ * @file    stats.cpp
+ * @brief   Código fonte da instrumentação do bares.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include "stats.h" // classe Stats.
+
+
+bool Stats::ativo = false;
+Stats::Contadores Stats::total;
+std::mutex Stats::trava;
+Stats::ticks_t Stats::inicio_ticks = 0;
+std::chrono::steady_clock::time_point Stats::inicio_relogio;
+
+
+/** @brief Soma outros contadores a estes.
+    @param o_ Contadores a somar. */
+void Stats::Contadores::somar( const Contadores & o_ ){
+    for( int i = 0; i < N_ESTAGIOS; ++i ){
+        ticks[i] += o_.ticks[i];
+        chamadas[i] += o_.chamadas[i];
+    }
+    expressoes += o_.expressoes;
+    tokens += o_.tokens;
+    alocacoes += o_.alocacoes;
+    for( int i = 0; i < N_ERROS_SINTAXE; ++i )
+        erros_sintaxe[i] += o_.erros_sintaxe[i];
+    for( int i = 0; i < N_ERROS_EXECUCAO; ++i )
+        erros_execucao[i] += o_.erros_execucao[i];
+    for( int i = 0; i < N_BALDES; ++i ){
+        parse.baldes[i] += o_.parse.baldes[i];
+        eval.baldes[i] += o_.eval.baldes[i];
+    }
+}
+
+/// Passa a coletar nos contadores locais, se --stats foi pedido.
+Stats::Coleta::Coleta(){
+    if ( BARES_STATS and ativo ){
+        anterior = atual;
+        atual = &local;
+        ligada = true;
+    }
+}
+
+/// Soma os contadores locais ao total.
+Stats::Coleta::~Coleta(){
+    if ( not ligada )
+        return;
+    atual = anterior;
+    std::lock_guard< std::mutex > lk( trava );
+    total.somar( local );
+}
+
+/** @brief Liga a coleta (--stats). Chamar antes de criar threads. */
+void Stats::ligar( void ){
+    ativo = true;
+    inicio_relogio = std::chrono::steady_clock::now();
+    inicio_ticks = agora();
+}
+
+/**
+ * @brief Escreve um histograma em JSON, com os percentis estimados pelo
+ * limite superior do balde.
+ * @param saida_ Fluxo de saída.
+ * @param h_ Histograma, em ticks.
+ * @param ns_por_tick_ Conversão de ticks para ns.
+ */
+static void escreverHistograma( std::ostream & saida_, const Stats::Histograma & h_, double ns_por_tick_ ){
+
+    std::uint64_t n = 0;
+    for( auto b : h_.baldes )
+        n += b;
+
+    // Limite superior do balde i, em ns.
+    auto limite = [&]( int i ){ return static_cast< std::uint64_t >( ns_por_tick_ * ( 2.0 * ( 1ull << i ) ) ); };
+
+    auto percentil = [&]( double q ) -> std::uint64_t {
+        std::uint64_t alvo = static_cast< std::uint64_t >( q * n + 0.5 ), acc = 0;
+        for( int i = 0; i < Stats::N_BALDES; ++i ){
+            acc += h_.baldes[i];
+            if ( acc >= alvo and acc > 0 )
+                return limite( i );
+        }
+        return 0;
+    };
+
+    saida_ << "{ \"n\": " << n
+           << ", \"p50\": " << percentil( 0.50 )
+           << ", \"p90\": " << percentil( 0.90 )
+           << ", \"p99\": " << percentil( 0.99 )
+           << ", \"p999\": " << percentil( 0.999 )
+           << ", \"histograma\": [";
+    bool primeiro = true;
+    for( int i = 0; i < Stats::N_BALDES; ++i ){
+        if ( h_.baldes[i] == 0 )
+            continue;
+        saida_ << ( primeiro ? " " : ", " ) << "{ \"ate_ns\": " << limite( i ) << ", \"n\": " << h_.baldes[i] << " }";
+        primeiro = false;
+    }
+    saida_ << " ] }";
+}
+
+/** @brief Escreve o total coletado em JSON.
+    @param saida_ Fluxo de saída. */
+void Stats::escreverJson( std::ostream & saida_ ){
+
+    static const char * const nomes_estagios[ N_ESTAGIOS ] = {
+        "initialize", "validarExpress", "converterExpress", "avaliarExpress",
+        "apresentar", "processarParalelo", "processarStream", "processarPipeline",
+        "processarBindings"
+    };
+    static const char * const nomes_sintaxe[ N_ERROS_SINTAXE ] = {
+        "PARSER_OK", "UNEXPECTED_END_OF_EXPRESSION", "ILL_FORMED_INTEGER", "MISSING_TERM",
+        "EXTRANEOUS_SYMBOL", "INTEGER_OUT_OF_RANGE", "MISSING_CLOSING_PARENTHESIS"
+    };
+    static const char * const nomes_execucao[ N_ERROS_EXECUCAO ] = {
+        "EVAL_OK", "DIVISION_BY_ZERO", "NUMERIC_OVERFLOW"
+    };
+
+    // Total das threads terminadas mais o da thread atual.
+    Contadores c;
+    {
+        std::lock_guard< std::mutex > lk( trava );
+        c = total;
+    }
+    if ( atual )
+        c.somar( *atual );
+
+    // Conversão de ticks para ns, medida sobre todo o tempo de coleta.
+    auto ns = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                  std::chrono::steady_clock::now() - inicio_relogio ).count();
+    auto ticks = agora() - inicio_ticks;
+    double ns_por_tick = ticks ? static_cast< double >( ns ) / ticks : 1.0;
+
+    saida_ << "{\n  \"compilado\": " << ( BARES_STATS ? "true" : "false" )
+           << ",\n  \"total_ns\": " << ns
+           << ",\n  \"estagios\": {";
+    bool primeiro = true;
+    for( int i = 0; i < N_ESTAGIOS; ++i ){
+        if ( c.chamadas[i] == 0 )
+            continue;
+        saida_ << ( primeiro ? "\n" : ",\n" ) << "    \"" << nomes_estagios[i] << "\": { \"chamadas\": "
+               << c.chamadas[i] << ", \"ns\": " << static_cast< std::uint64_t >( c.ticks[i] * ns_por_tick ) << " }";
+        primeiro = false;
+    }
+    saida_ << "\n  },\n  \"expressoes\": " << c.expressoes
+           << ",\n  \"tokens\": " << c.tokens
+           << ",\n  \"alocacoes\": " << c.alocacoes
+           << ",\n  \"erros_sintaxe\": {";
+    for( int i = 1; i < N_ERROS_SINTAXE; ++i )
+        saida_ << ( i > 1 ? ", " : " " ) << "\"" << nomes_sintaxe[i] << "\": " << c.erros_sintaxe[i];
+    saida_ << " },\n  \"erros_execucao\": {";
+    for( int i = 1; i < N_ERROS_EXECUCAO; ++i )
+        saida_ << ( i > 1 ? ", " : " " ) << "\"" << nomes_execucao[i] << "\": " << c.erros_execucao[i];
+    saida_ << " },\n  \"parse_ns\": ";
+    escreverHistograma( saida_, c.parse, ns_por_tick );
+    saida_ << ",\n  \"eval_ns\": ";
+    escreverHistograma( saida_, c.eval, ns_por_tick );
+    saida_ << "\n}\n";
+}
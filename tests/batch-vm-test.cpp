@@ -0,0 +1,161 @@
+/**
+ * @file    batch-vm-test.cpp
+ * @brief   Teste diferencial da máquina virtual colunar: executa os
+            mesmos programas com cada conjunto de kernels (AVX2, SSE4.1
+            e escalar) e compara, linha a linha, o valor e o primeiro
+            erro com os de VM::run.
+ * @author  Jaine Budke (jainebudke@hotmail.com)
+ * @since   02/05/2017
+ * @date    23/05/2017
+ */
+
+#include <iostream>  // cout, cerr
+#include <vector>    // std::vector
+#include <random>    // std::mt19937_64
+#include <limits>    // std::numeric_limits
+#include <cstdint>   // std::uint8_t
+
+#include "batch-vm.h" // classe BatchVM.
+#include "bytecode.h" // Program, VM.
+
+typedef Token::value_type valor_t;
+typedef Instruction::opcode_t opcode_t;
+
+/**
+ * @brief Valores de borda: extremos de 64 bits, sinal, zero e os
+ *        vizinhos da fronteira de 32 bits (onde os kernels de
+ *        multiplicação trocam o caminho vetorial pelo escalar).
+ * @return Lista de valores.
+ */
+static std::vector< valor_t > bordas( void ){
+    const valor_t min = std::numeric_limits< valor_t >::min();
+    const valor_t max = std::numeric_limits< valor_t >::max();
+    const valor_t b31 = 1LL << 31;
+    const valor_t b32 = 1LL << 32;
+    return { min, min + 1, max, max - 1, -1, 0, 1, 2, -2,
+             b31 - 1, b31, b31 + 1, -b31 + 1, -b31, -b31 - 1,
+             b32 - 1, b32, -b32, 3037000499LL, 3037000500LL, -3037000500LL };
+}
+
+/**
+ * @brief Monta um programa a partir de uma lista de instruções.
+ * @param ins Instruções, em ordem.
+ * @param prog Recebe o programa; max_depth é calculado aqui.
+ */
+static void montar( std::initializer_list< Instruction > ins, Program & prog ){
+    prog.code.clear();
+    size_t sp = 0;
+    prog.max_depth = 0;
+    for( const auto & i : ins ){
+        prog.code.push_back( i );
+        if ( i.op == opcode_t::PUSH or i.op == opcode_t::LOAD )
+            ++sp;
+        else if ( i.op != opcode_t::SQR )
+            --sp;
+        if ( sp > prog.max_depth )
+            prog.max_depth = sp;
+    }
+}
+
+/**
+ * @brief Compara BatchVM e VM::run para um programa, linha a linha.
+ * @param bvm Máquina colunar, já com os kernels escolhidos.
+ * @param nome Nome do programa (para as mensagens).
+ * @param prog Programa.
+ * @param cols Valor de cada variável em cada linha.
+ * @return Número de linhas divergentes.
+ */
+static size_t comparar( BatchVM & bvm, const char * nome, const Program & prog,
+                        const std::vector< std::vector< valor_t > > & cols ){
+    const size_t n = cols[0].size();
+    std::vector< const valor_t * > ptrs;
+    for( const auto & c : cols )
+        ptrs.push_back( c.data() );
+
+    std::vector< valor_t > valores( n );
+    std::vector< std::uint8_t > erros( n );
+    bvm.run( prog, ptrs.data(), n, valores.data(), erros.data() );
+
+    VM vm;
+    size_t falhas = 0;
+    std::vector< valor_t > vars( cols.size() );
+    for( size_t i = 0; i < n; ++i ){
+        for( size_t v = 0; v < cols.size(); ++v )
+            vars[v] = cols[v][i];
+        EvalResult r = vm.run( prog, vars.data() );
+        if ( r.type == erros[i] and r.value == valores[i] )
+            continue;
+        if ( ++falhas <= 10 ){
+            std::cerr << bvm.isa() << " " << nome << " linha " << i << " (";
+            for( size_t v = 0; v < vars.size(); ++v )
+                std::cerr << ( v ? ", " : "" ) << vars[v];
+            std::cerr << "): esperado " << r.value << "/" << r.type
+                      << ", obtido " << valores[i] << "/" << int( erros[i] ) << "\n";
+        }
+    }
+    return falhas;
+}
+
+int main( void ){
+
+    // Linhas: todos os pares de valores de borda, mais valores aleatórios
+    // (pequenos, perto de 32 bits e de 64 bits). O total não é múltiplo
+    // de 4 nem de BLOCO, para cobrir as sobras dos laços vetoriais.
+    const auto b = bordas();
+    std::vector< std::vector< valor_t > > cols( 3 );
+    for( auto x : b )
+        for( auto y : b )
+            for( auto z : { b[ ( x & 7 ) % b.size() ], valor_t( 0 ), valor_t( -1 ) } ){
+                cols[0].push_back( x );
+                cols[1].push_back( y );
+                cols[2].push_back( z );
+            }
+    std::mt19937_64 rng( 2017 );
+    for( size_t i = 0; i < 3 * BatchVM::BLOCO + 3; ++i )
+        for( auto & c : cols ){
+            valor_t v = static_cast< valor_t >( rng() );
+            switch( rng() % 3 ){
+                case 0: v %= 1000; break;
+                case 1: v %= ( 1LL << 33 ); break;
+                default: break;
+            }
+            c.push_back( v );
+        }
+
+    auto load = []( valor_t k ){ return Instruction{ k, opcode_t::LOAD }; };
+    auto op = []( opcode_t o ){ return Instruction{ 0, o }; };
+
+    struct Caso { const char * nome; Program prog; };
+    std::vector< Caso > casos( 10 );
+    casos[0].nome = "x+y"; montar( { load( 0 ), load( 1 ), op( opcode_t::ADD ) }, casos[0].prog );
+    casos[1].nome = "x-y"; montar( { load( 0 ), load( 1 ), op( opcode_t::SUB ) }, casos[1].prog );
+    casos[2].nome = "x*y"; montar( { load( 0 ), load( 1 ), op( opcode_t::MUL ) }, casos[2].prog );
+    casos[3].nome = "x^2"; montar( { load( 0 ), op( opcode_t::SQR ) }, casos[3].prog );
+    casos[4].nome = "x/y"; montar( { load( 0 ), load( 1 ), op( opcode_t::DIV ) }, casos[4].prog );
+    casos[5].nome = "x%y"; montar( { load( 0 ), load( 1 ), op( opcode_t::MOD ) }, casos[5].prog );
+    casos[6].nome = "x^y"; montar( { load( 0 ), load( 1 ), op( opcode_t::POW ) }, casos[6].prog );
+    // Primeiro erro: o overflow de x*y vem antes da divisão por z.
+    casos[7].nome = "(x*y)/z"; montar( { load( 0 ), load( 1 ), op( opcode_t::MUL ), load( 2 ),
+                                         op( opcode_t::DIV ) }, casos[7].prog );
+    casos[8].nome = "z/x+y*y"; montar( { load( 2 ), load( 0 ), op( opcode_t::DIV ), load( 1 ), load( 1 ),
+                                         op( opcode_t::MUL ), op( opcode_t::ADD ) }, casos[8].prog );
+    casos[9].nome = "(x-y)^2-z*x"; montar( { load( 0 ), load( 1 ), op( opcode_t::SUB ), op( opcode_t::SQR ),
+                                             load( 2 ), load( 0 ), op( opcode_t::MUL ), op( opcode_t::SUB ) },
+                                           casos[9].prog );
+
+    size_t falhas = 0;
+    BatchVM bvm;
+    for( const char * isa : { "avx2", "sse4.1", "scalar" } ){
+        if ( not bvm.forcar( isa ) ){
+            std::cout << isa << ": indisponivel nesta CPU, pulado\n";
+            continue;
+        }
+        size_t antes = falhas;
+        for( const auto & c : casos )
+            falhas += comparar( bvm, c.nome, c.prog, cols );
+        std::cout << isa << ": " << cols[0].size() << " linhas x " << casos.size() << " programas, "
+                  << falhas - antes << " divergencias\n";
+    }
+
+    return falhas == 0 ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+# Roda o bares sobre uma entrada em cada modo de execução e compara o
+# resultados.txt produzido com o esperado, byte a byte.
+#
+# Uso: cmake -DBARES=<executável> -DENTRADA=<arquivo> -DESPERADO=<arquivo>
+#            -DDIR=<diretório de trabalho> -P resultados.cmake
+
+foreach( var BARES ENTRADA ESPERADO DIR )
+    if ( NOT DEFINED ${var} )
+        message( FATAL_ERROR "resultados.cmake: falta -D${var}" )
+    endif()
+endforeach()
+
+file( MAKE_DIRECTORY ${DIR} )
+
+# Um modo por item; as opções de cada modo são separadas por vírgula.
+set( MODOS
+    "-q"
+    "--jobs,4"
+    "--stream,--jobs,2"
+    "--pipeline,--jobs,3"
+    "--cache,16"
+    "--jobs,4,--cache,16"
+)
+
+foreach( modo IN LISTS MODOS )
+    string( REPLACE "," ";" args "${modo}" )
+    string( REPLACE "," " " nome "${modo}" )
+    file( REMOVE ${DIR}/resultados.txt )
+    execute_process(
+        COMMAND ${BARES} ${args} ${ENTRADA}
+        WORKING_DIRECTORY ${DIR}
+        RESULT_VARIABLE rc
+        OUTPUT_QUIET
+    )
+    if ( NOT rc EQUAL 0 )
+        message( FATAL_ERROR "bares ${nome}: saiu com ${rc}" )
+    endif()
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files ${DIR}/resultados.txt ${ESPERADO}
+        RESULT_VARIABLE diferente
+    )
+    if ( diferente )
+        message( FATAL_ERROR "bares ${nome}: resultados.txt difere de ${ESPERADO}" )
+    endif()
+    message( STATUS "bares ${nome}: ok" )
+endforeach()